@@ -0,0 +1,222 @@
+#!/usr/bin/env python3
+import argparse
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tarfile
+import time
+from pathlib import Path as P
+
+here = P(__file__).resolve().parent
+top = here.parent
+
+parser = argparse.ArgumentParser(
+                    prog='bench.py',
+                    description='Benchmark the section3 tools over a ladder of sequences')
+parser.add_argument('seqs', nargs='*', default=['fib', 'pell', 'bece', 'tri'],
+                    help="Numeration systems, from the smallest to the largest (default: fib pell bece tri)")
+parser.add_argument('-j', '--threads', type=int, default=os.cpu_count(), help="Number of OpenMP threads")
+parser.add_argument('-t', '--tools', default='first2comp,difffirst,occ2equi',
+                    help="Comma separated list of tools to run")
+parser.add_argument('-b', '--bindir', default=str(top / 'src'), help="Directory of the compiled tools")
+parser.add_argument('-w', '--workdir', default=str(top / 'bench'), help="Directory where inputs are staged")
+parser.add_argument('-W', '--walnut-home', default=os.environ.get('WALNUT_HOME'),
+                    help="Walnut home providing (or computing) the occ_* automata")
+parser.add_argument('-B', '--baseline', default=str(top / 'out' / 'bench_baseline.tsv'), help="Baseline file")
+parser.add_argument('-o', '--output', default=None, help="Result file (default: [workdir]/bench.tsv)")
+parser.add_argument('-p', '--pivots', default=None,
+                    help="Comma separated list of pivot strategies (ABCOMP_PIVOT: norm, bitsize, "
+                         "colcount, first) to compare")
+parser.add_argument('-u', '--update-baseline', action='store_true', help="Replace the baseline with this run")
+parser.add_argument('--seed', nargs='+', metavar='LOG',
+                    help="Build the baseline from existing tool logs instead of running anything")
+args = parser.parse_args()
+
+FIELDS = ['seq', 'tool', 'threads', 'stage', 'seconds', 'states', 'transitions', 'throughput', 'maxrss_kb',
+          'pivot', 'limbs', 'elim_seconds']
+
+# Which staged files each tool needs, and its command line.
+TOOLS = {
+    'first2comp': (lambda ns: [f'abfirst{ns}.txt'],
+                   lambda ns: ['first2comp', f'abfirst{ns}.txt', f'abcomp_{ns}.txt']),
+    'difffirst': (lambda ns: [f'abfirst{ns}.txt', f'abfirsts{ns}.txt'],
+                  lambda ns: ['difffirst', ns]),
+    'occ2equi': (lambda ns: [f'occ_{ns}.txt'],
+                 lambda ns: ['occ2equi', ns]),
+}
+
+TARBALLS = ['abcomp.tar.xz', 'abcomp_bece.tar.xz']
+
+
+def parse_duration(s):
+    s = s.strip()
+    if s.endswith('s'):
+        return float(s[:-1])
+    t = 0
+    for x in s.split(':'):
+        t = 60 * t + int(x)
+    return float(t)
+
+
+def parse_log(lines):
+    """Split a tool log into its stages: the title line, the last
+    "x states, y transitions" summary, the ">>>" duration, the
+    throughput (transitions of that summary per second, only for the
+    stages that have one) and the GMP limbs and elimination time
+    reported by the reductions."""
+    stages = []
+    title, states, transitions = None, '-', '-'
+    limbs, elim = None, 0.0
+    threads = '-'
+    for line in lines:
+        line = line.rstrip('\n')
+        m = re.search(r'starting left_reduce with (\d+) threads', line)
+        if m:
+            threads = m.group(1)
+        m = re.match(r'\[pivot \w+: (\d+) limbs, ([\d.e+-]+)s\]', line)
+        if m:
+            limbs = (limbs or 0) + int(m.group(1))
+            elim += float(m.group(2))
+        if title is None:
+            if line.strip() and not line.startswith('.') and not line.startswith('['):
+                title = line.lstrip('* ').strip()
+            continue
+        m = re.match(r'(\d+) states, (\d+) transitions', line)
+        if m:
+            states, transitions = m.groups()
+        elif line.startswith('>>>'):
+            sec = parse_duration(line[3:])
+            rate = f'{int(transitions) / sec:.0f}' if transitions != '-' and sec > 0 else '-'
+            stages.append((title, sec, states, transitions, rate,
+                           '-' if limbs is None else limbs, '-' if limbs is None else f'{elim:.3f}'))
+            title, states, transitions = None, '-', '-'
+            limbs, elim = None, 0.0
+    return threads, stages
+
+
+def read_tsv(path):
+    rows = {}
+    if not P(path).exists():
+        return rows
+    with open(path) as f:
+        header = f.readline().rstrip('\n').split('\t')
+        for line in f:
+            r = dict(zip(header, line.rstrip('\n').split('\t')))
+            rows[(r['seq'], r['tool'], r['stage'])] = r
+    return rows
+
+
+def write_tsv(path, rows):
+    with open(path, 'w') as f:
+        f.write('\t'.join(FIELDS) + '\n')
+        for r in rows:
+            f.write('\t'.join(str(r.get(k, '-')) for k in FIELDS) + '\n')
+
+
+if args.seed:
+    rows = []
+    for log in args.seed:
+        m = re.match(r'(?:difffirst_|first2comp_|equi)([a-z]+)\.log', P(log).name)
+        tool = 'occ2equi' if P(log).name.startswith('equi') else P(log).name.split('_')[0]
+        with open(log) as f:
+            threads, stages = parse_log(f)
+        for (stage, sec, st, tr, rate, limbs, elim) in stages:
+            rows.append(dict(seq=m.group(1), tool=tool, threads=threads, stage=stage,
+                             seconds=f'{sec:.3f}', states=st, transitions=tr, throughput=rate,
+                             maxrss_kb='-', pivot='-', limbs=limbs, elim_seconds=elim))
+    write_tsv(args.baseline, rows)
+    print(f"{len(rows)} stages written to {args.baseline}")
+    sys.exit(0)
+
+
+def stage_inputs(work, ns, needed):
+    """Copy the automata a tool needs into the work directory."""
+    for name in needed:
+        if (work / name).exists():
+            continue
+        for tb in TARBALLS:
+            with tarfile.open(top / 'out' / tb) as t:
+                for m in t.getmembers():
+                    if P(m.name).name == name:
+                        with open(work / name, 'wb') as f:
+                            shutil.copyfileobj(t.extractfile(m), f)
+                        break
+            if (work / name).exists():
+                break
+        if not (work / name).exists() and args.walnut_home:
+            lib = P(args.walnut_home) / 'Automata Library'
+            if not (lib / name).exists() and name.startswith('occ_') and 'WALNUT_JAR' in os.environ:
+                # stage 1 of the pipeline, see input/gen_occ.txt
+                with open(top / 'input' / 'gen_occ.txt') as f:
+                    cmd = [line for line in f if line.startswith(f'def occ_{ns} ')]
+                subprocess.run(['java', f"-Xmx{os.environ.get('WALNUT_MEM', '64g')}",
+                                '-jar', os.environ['WALNUT_JAR']],
+                               input=''.join(cmd), text=True, cwd=args.walnut_home,
+                               stdout=subprocess.DEVNULL, check=True)
+            if (lib / name).exists():
+                shutil.copy(lib / name, work / name)
+        if not (work / name).exists():
+            return False
+    return True
+
+
+def run(work, cmd, pivot):
+    """Run a tool, return its output lines, wall time and peak RSS (KiB)."""
+    env = dict(os.environ, OMP_NUM_THREADS=str(args.threads))
+    if pivot:
+        env['ABCOMP_PIVOT'] = pivot
+    t0 = time.monotonic()
+    proc = subprocess.Popen([str(P(args.bindir) / cmd[0])] + cmd[1:], cwd=work, env=env,
+                            stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    out = proc.stdout.readlines()
+    _, status, usage = os.wait4(proc.pid, 0)
+    wall = time.monotonic() - t0
+    rss = usage.ru_maxrss // 1024 if sys.platform == 'darwin' else usage.ru_maxrss
+    return out, wall, rss, os.waitstatus_to_exitcode(status)
+
+
+work = P(args.workdir)
+work.mkdir(parents=True, exist_ok=True)
+baseline = read_tsv(args.baseline)
+rows = []
+
+pivots = args.pivots.split(',') if args.pivots else [None]
+print(f"{'seq':>6} {'tool':>10} {'pivot':>9} {'stage':>24} {'time':>10} {'base':>10} {'speedup':>8} "
+      f"{'states':>8} {'limbs':>10} {'rss(MiB)':>9}")
+print('-' * 124)
+for ns in args.seqs:
+    for tool in args.tools.split(','):
+        needed, cmd = TOOLS[tool]
+        if not stage_inputs(work, ns, needed(ns)):
+            print(f"{ns:>6} {tool:>10} {'':>9} {'(missing input, skipped)':>24}")
+            continue
+        for pivot in pivots:
+            out, wall, rss, code = run(work, cmd(ns), pivot)
+            suffix = f'.{pivot}' if pivot else ''
+            with open(work / f'{tool}_{ns}.{args.threads}{suffix}.log', 'w') as f:
+                f.writelines(out)
+            pv = pivot or os.environ.get('ABCOMP_PIVOT') or 'norm'
+            if code != 0:
+                print(f"{ns:>6} {tool:>10} {pv:>9} {'(failed with status ' + str(code) + ')':>24}")
+                continue
+            _, stages = parse_log(out)
+            stages.append(('total', wall, '-', '-', '-', '-', '-'))
+            for (stage, sec, st, tr, rate, limbs, elim) in stages:
+                if sec < 0.001 and stage != 'total':
+                    continue
+                rows.append(dict(seq=ns, tool=tool, threads=args.threads, stage=stage,
+                                 seconds=f'{sec:.3f}', states=st, transitions=tr, throughput=rate,
+                                 maxrss_kb=rss, pivot=pv, limbs=limbs, elim_seconds=elim))
+                b = baseline.get((ns, tool, stage))
+                base = f"{float(b['seconds']):.3f}" if b else '-'
+                speedup = f"{float(b['seconds']) / sec:.2f}x" if b and sec >= 0.01 and float(b['seconds']) >= 0.01 else '-'
+                print(f"{ns:>6} {tool:>10} {pv:>9} {stage[:24]:>24} {sec:>10.3f} {base:>10} {speedup:>8} "
+                      f"{st:>8} {limbs:>10} {rss // 1024:>9}")
+                if b and b['states'] not in ('-', st) and st != '-':
+                    print(f"{'':>6} {'':>10} {'':>9} {'!! state count differs from baseline: ' + b['states']}")
+
+write_tsv(args.output or work / 'bench.tsv', rows)
+if args.update_baseline:
+    write_tsv(args.baseline, rows)
@@ -0,0 +1,298 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <optional>
+#include <unordered_map>
+
+#include "dfao.hh"
+
+
+using namespace std;
+using namespace awali::sttc;
+using namespace dfa;
+
+auto now() {
+    return chrono::steady_clock::now();
+}
+
+void log_duration(const std::string& label, std::chrono::steady_clock::time_point start) {
+    using namespace std;
+    auto end = chrono::steady_clock::now();
+    auto duration_ms = chrono::duration_cast<chrono::milliseconds>(end - start).count();
+
+    long long total_seconds = duration_ms / 1000;
+
+    cout << label << " ";
+
+    if (total_seconds < 60) {
+        // Format : 4.321s
+        cout << fixed << setprecision(3) << (duration_ms / 1000.0) << "s";
+    } else {
+        int hours = static_cast<int>(total_seconds / 3600);
+        int minutes = static_cast<int>((total_seconds % 3600) / 60);
+        int seconds = static_cast<int>(total_seconds % 60);
+
+        if (hours > 0)
+            cout << hours << ":" << setfill('0') << setw(2);
+        cout << minutes << ":" << setfill('0') << setw(2) << seconds;
+    }
+
+    cout << endl << endl;
+}
+
+/*
+  Inductive check of Equifoo, as the Walnut script of checkequi.py,
+  with E = Equifoo(i,j1,j2,k,n) and F = feq_foo:
+  - base case: E(i,j1,j2,k,0) = F(i,j1,k) - F(i,j2,k);
+  - step: E(i,j1,j2,k,n+1) - E(i,j1,j2,k,n) = F(i,j1+n+1,k) - F(i,j2+n+1,k);
+  for all the valid i, j1, j2, k, n.  Both are checked on the
+  synchronized product of the DFAs, read msd first: the states are the
+  tuples of their states, with the hidden tracks m = n+1, u1 = j1+m and
+  u2 = j2+m checked by the addition, and the identity is checked in
+  every state where all the tracks are valid.  The product is walked
+  breadth first, one level (length) after the other, and the
+  successors of a level are computed in parallel: the first
+  counterexample found is a shortest one.  C, the largest |E| met by
+  the step walk, bounds the uniform factor equilibrium of Foo.
+*/
+
+// the largest product: E twice, F twice, the word of 1, three
+// additions and the five free tracks
+using product_t = array<int, 13>;
+
+struct product_hash {
+    size_t operator()(const product_t& k) const {
+        size_t h = 0;
+        for (int x : k)
+            h ^= std::hash<int> {}(x) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        return h;
+    }
+};
+
+struct walk_result {
+    size_t states = 0;
+    int bound = 0;
+    // letters of E (with n = 0 in the base case) of the counterexample
+    optional<vector<int>> counterexample;
+};
+
+/// Breadth first walk of the product from start: expand(k, push) calls
+/// push(letter, successor) for the successors of k, check(k) returns
+/// false on a counterexample and value(k) the value of E to bound (in
+/// the valid states only, i.e. where check is called).
+template<typename Expand, typename Valid, typename Check, typename Value>
+walk_result product_walk(const product_t& start, const Expand& expand, const Valid& valid,
+                         const Check& check, const Value& value,
+                         exec_context& ctx = exec_context::global()) {
+    walk_result res;
+    unordered_map<product_t, int, product_hash> index;
+    vector<product_t> keys;
+    vector<pair<int, int>> parent;     // (state, letter)
+
+    auto path = [&](int q) {
+        vector<int> w;
+        for (; parent[q].first >= 0; q = parent[q].first)
+            w.push_back(parent[q].second);
+        return vector<int>(w.rbegin(), w.rend());
+    };
+
+    auto add = [&](const product_t& k, int from, int letter) {
+        if (!index.emplace(k, keys.size()).second)
+            return true;
+        keys.push_back(k);
+        parent.emplace_back(from, letter);
+        if (!valid(k))
+            return true;
+        res.bound = max(res.bound, abs(value(k)));
+        if (check(k))
+            return true;
+        res.counterexample = path(keys.size() - 1);
+        return false;
+    };
+
+    add(start, -1, 0);
+    size_t begin = 0;
+    while (begin < keys.size() && !res.counterexample) {
+        size_t end = keys.size();
+        vector<vector<pair<int, product_t>>> succ(end - begin);
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (size_t q = begin; q < end; ++q)
+            if (!ctx.poll())
+                expand(keys[q], [&](int letter, const product_t& k) {
+                    succ[q - begin].emplace_back(letter, k);
+                });
+        ctx.check();
+        for (size_t q = begin; q < end && !res.counterexample; ++q)
+            for (const auto& [letter, k] : succ[q - begin])
+                if (!add(k, q, letter))
+                    break;
+        ctx.check_states(keys.size());
+        begin = end;
+    }
+    res.states = keys.size();
+    return res;
+}
+
+void show_counterexample(const dfa_table& E, const vector<int>& w) {
+    const char* names[] = {"i", "j1", "j2", "k", "n"};
+    for (int t = 0; t < E.arity; ++t) {
+        cout << "  " << names[t] << " = ";
+        for (int c : w)
+            cout << E.digit(c, t);
+        cout << endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    string prefix = "Equi";
+    int a = 1;
+    if (argc == 4 && string(argv[1]) == "-p") {
+        prefix = argv[2];
+        a = 3;
+    }
+    if (argc != a + 1) {
+        cerr << "Usage: " << argv[0] << " [-p prefix] ns\n"
+             << "  where ns is a numeration system; checks [prefix][ns].txt (Equi by default)\n"
+             << "  by induction on n against feq_[ns].txt, with msd_[ns]_addition.txt\n"
+             << "  and msd_[ns].txt, and prints the bound C\n"
+             << "  Exit status: 0 if proved, 1 on a counterexample\n";
+        return 1;
+    }
+
+    string dt = argv[a];
+    string ns = "msd_" + dt;
+
+    return run_tool([&]() {
+        vector<map<vector<int>,int>> equi, feq, add, valid;
+        vector<int> equi_out, feq_out, add_out, valid_out;
+        LabelMapper equimap, feqmap, addmap, validmap;
+
+        cout << "* Chargement de " << prefix << dt << ", feq_" << dt << ", "
+             << ns << "_addition et " << ns << endl;
+        auto t0 = now();
+        dfa_from_walnut(prefix + dt + ".txt", equi, equi_out, equimap);
+        dfa_from_walnut("feq_" + dt + ".txt", feq, feq_out, feqmap);
+        dfa_from_walnut(ns + "_addition.txt", add, add_out, addmap);
+        dfa_from_walnut(ns + ".txt", valid, valid_out, validmap);
+        int base = 0;
+        for (const auto* m : {&equimap, &feqmap, &addmap, &validmap})
+            for (int d : digits_of(*m))
+                base = max(base, d + 1);
+        dfa_table E(equi, equi_out, base), F(feq, feq_out, base),
+            A(add, add_out, base), V(valid, valid_out, base);
+        if (E.arity != 5 || F.arity != 3 || A.arity != 3 || V.arity != 1)
+            throw runtime_error("unexpected number of tracks");
+        cout << E.size() << " states (" << prefix << dt << "), " << F.size()
+             << " states (feq_" << dt << ")" << endl;
+        log_duration(">>>", t0);
+
+        auto code = [&](const dfa_table& T, initializer_list<int> d) {
+            return T.code(vector<int>(d));
+        };
+        auto f = [&](int q) { return F.accepts(q) ? 1 : 0; };
+
+        // base case: (E, F(i,j1,k), F(i,j2,k), valid i, j1, j2, k)
+        cout << "Cas de base" << endl;
+        t0 = now();
+        auto base_case = product_walk(
+            product_t{0, 0, 0, 0, 0, 0, 0},
+            [&](const product_t& k, const auto& push) {
+                for (int c = 0; c < E.letters; ++c) {
+                    int i = E.digit(c, 0), j1 = E.digit(c, 1), j2 = E.digit(c, 2),
+                        kk = E.digit(c, 3);
+                    if (E.digit(c, 4) != 0)
+                        continue;
+                    product_t s{E(k[0], c), F(k[1], code(F, {i, j1, kk})),
+                            F(k[2], code(F, {i, j2, kk})),
+                            V(k[3], i), V(k[4], j1), V(k[5], j2), V(k[6], kk)};
+                    if (s[0] >= 0 && s[3] >= 0 && s[4] >= 0 && s[5] >= 0 && s[6] >= 0)
+                        push(c, s);
+                }
+            },
+            [&](const product_t& k) {
+                return V.accepts(k[3]) && V.accepts(k[4]) && V.accepts(k[5]) && V.accepts(k[6]);
+            },
+            [&](const product_t& k) { return E.out[k[0]] == f(k[1]) - f(k[2]); },
+            [&](const product_t& k) { return E.out[k[0]]; });
+        cout << base_case.states << " states" << endl;
+        log_duration(">>>", t0);
+        if (base_case.counterexample) {
+            cout << "Contre-exemple (cas de base):" << endl;
+            show_counterexample(E, *base_case.counterexample);
+            return 1;
+        }
+
+        // step: (E(n), E(m), F(i,u1,k), F(i,u2,k), word of 1, n+1=m,
+        // j1+m=u1, j2+m=u2, valid i, j1, j2, k, n); the word of 1 is
+        // 0*1: 0 while reading zeros, 1 after the last digit
+        cout << "Hérédité" << endl;
+        t0 = now();
+        auto step = product_walk(
+            product_t{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+            [&](const product_t& k, const auto& push) {
+                if (k[4] != 0)
+                    return;
+                for (int c = 0; c < E.letters; ++c) {
+                    int en = E(k[0], c);
+                    if (en < 0)
+                        continue;
+                    int d[5];
+                    for (int t = 0; t < 5; ++t)
+                        d[t] = E.digit(c, t);
+                    product_t s;
+                    s[0] = en;
+                    bool ok = true;
+                    for (int t = 0; t < 5 && ok; ++t)
+                        ok = (s[8 + t] = V(k[8 + t], d[t])) >= 0;
+                    if (!ok)
+                        continue;
+                    for (int y = 0; y < 2; ++y) {
+                        s[4] = y;
+                        for (int m = 0; m < base; ++m) {
+                            s[5] = A(k[5], code(A, {d[4], y, m}));
+                            s[1] = E(k[1], code(E, {d[0], d[1], d[2], d[3], m}));
+                            if (s[5] < 0 || s[1] < 0)
+                                continue;
+                            for (int u1 = 0; u1 < base; ++u1) {
+                                s[6] = A(k[6], code(A, {d[1], m, u1}));
+                                if (s[6] < 0)
+                                    continue;
+                                s[2] = F(k[2], code(F, {d[0], u1, d[3]}));
+                                for (int u2 = 0; u2 < base; ++u2) {
+                                    s[7] = A(k[7], code(A, {d[2], m, u2}));
+                                    if (s[7] < 0)
+                                        continue;
+                                    s[3] = F(k[3], code(F, {d[0], u2, d[3]}));
+                                    push(c, s);
+                                }
+                            }
+                        }
+                    }
+                }
+            },
+            [&](const product_t& k) {
+                if (k[4] != 1 || !A.accepts(k[5]) || !A.accepts(k[6]) || !A.accepts(k[7]))
+                    return false;
+                for (int t = 8; t < 13; ++t)
+                    if (!V.accepts(k[t]))
+                        return false;
+                return true;
+            },
+            [&](const product_t& k) { return E.out[k[1]] - E.out[k[0]] == f(k[2]) - f(k[3]); },
+            [&](const product_t& k) { return E.out[k[0]]; });
+        cout << step.states << " states" << endl;
+        log_duration(">>>", t0);
+        if (step.counterexample) {
+            cout << "Contre-exemple (hérédité):" << endl;
+            show_counterexample(E, *step.counterexample);
+            return 1;
+        }
+
+        cout << "Prouvé: C = " << max(base_case.bound, step.bound) << endl;
+        return 0;
+    });
+}
@@ -0,0 +1,254 @@
+#ifndef ABCOMP_CONTEXT_HH
+#define ABCOMP_CONTEXT_HH
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/resource.h>
+
+namespace awali {
+namespace sttc {
+
+/*
+  Execution context of the long stages (reductions, counting automata,
+  explorations): budgets read from the environment and a cooperative
+  cancellation flag.
+  - ABCOMP_MAX_TIME: seconds since the creation of the context (the
+    start of the tool for the global one);
+  - ABCOMP_MAX_MEM: peak resident memory, in KiB or with a suffix
+    k, m, g or t (e.g. 32g);
+  - ABCOMP_MAX_STATES: states of an exploration.
+  SIGINT and SIGTERM (once install_signal_handlers is called) set the
+  flag as well, and so does the flag of the parent context, if any:
+  the jobs that a tool runs concurrently have their own contexts, so
+  that a budget of one job only stops that job, but they all stop
+  with the tool.  The stages poll the flag in their loops, the
+  parallel ones skip their remaining work, and stop_error is thrown
+  outside of the parallel regions.  Each reason has its exit status.
+  The stages write their log lines to the stream of the context.
+*/
+enum class stop_reason { none = 0, interrupted, time, memory, size };
+
+inline const char* to_string(stop_reason r)
+{
+    switch (r) {
+    case stop_reason::interrupted: return "interrupted";
+    case stop_reason::time: return "time budget exceeded (ABCOMP_MAX_TIME)";
+    case stop_reason::memory: return "memory budget exceeded (ABCOMP_MAX_MEM)";
+    case stop_reason::size: return "size budget exceeded";
+    default: return "running";
+    }
+}
+
+inline int exit_status(stop_reason r)
+{
+    switch (r) {
+    case stop_reason::interrupted: return 130;
+    case stop_reason::time: return 2;
+    case stop_reason::memory: return 3;
+    case stop_reason::size: return 4;
+    default: return 0;
+    }
+}
+
+class stop_error : public std::runtime_error
+{
+public:
+    explicit stop_error(stop_reason r)
+        : std::runtime_error(to_string(r)), reason(r)
+    {}
+
+    stop_reason reason;
+};
+
+namespace internal
+{
+inline volatile std::sig_atomic_t interrupted = 0;
+
+inline void on_interrupt(int sig)
+{
+    interrupted = 1;
+    // a second signal kills the tool
+    std::signal(sig, SIG_DFL);
+}
+
+/// Size in KiB of the value of the variable name (0 if it is not set).
+inline std::size_t kib_from_env(const char* name)
+{
+    const char* s = std::getenv(name);
+    if (s == nullptr || *s == 0)
+        return 0;
+    char* end;
+    double x = std::strtod(s, &end);
+    const std::string units = "kmgt";
+    auto u = *end == 0 ? 0 : units.find(*end | 0x20);
+    if (x < 0 || u == std::string::npos || (*end != 0 && end[1] != 0))
+        throw std::invalid_argument(std::string(name) + ": not a size: " + s);
+    while (u-- > 0)
+        x *= 1024;
+    return x;
+}
+
+inline double number_from_env(const char* name)
+{
+    const char* s = std::getenv(name);
+    if (s == nullptr || *s == 0)
+        return 0;
+    char* end;
+    double x = std::strtod(s, &end);
+    if (*end != 0 || x < 0)
+        throw std::invalid_argument(std::string(name) + ": not a number: " + s);
+    return x;
+}
+}
+
+inline void install_signal_handlers()
+{
+    std::signal(SIGINT, internal::on_interrupt);
+    std::signal(SIGTERM, internal::on_interrupt);
+}
+
+class exec_context
+{
+public:
+    exec_context()
+        : max_seconds(internal::number_from_env("ABCOMP_MAX_TIME"))
+        , max_kib(internal::kib_from_env("ABCOMP_MAX_MEM"))
+        , max_states(internal::number_from_env("ABCOMP_MAX_STATES"))
+        , start_(std::chrono::steady_clock::now())
+    {}
+
+    /// A context configured from the environment whose flag is also
+    /// set by the one of parent.
+    explicit exec_context(exec_context& parent)
+        : exec_context()
+    {
+        parent_ = &parent;
+        log_ = parent.log_;
+    }
+
+    /// The context of the tool, configured from the environment.
+    static exec_context& global()
+    {
+        static exec_context ctx;
+        return ctx;
+    }
+
+    void cancel(stop_reason r)
+    {
+        int none = 0;
+        reason_.compare_exchange_strong(none, static_cast<int>(r));
+    }
+
+    /// The flag only: cheap enough for the inner loops.
+    bool stopped() const
+    {
+        return reason_.load(std::memory_order_relaxed) != 0;
+    }
+
+    stop_reason reason() const
+    {
+        return static_cast<stop_reason>(reason_.load());
+    }
+
+    /// Update the flag from the signals and the budgets (the clock and
+    /// the memory are read once every 256 calls); thread safe.
+    bool poll()
+    {
+        if (internal::interrupted)
+            cancel(stop_reason::interrupted);
+        if (parent_ != nullptr && parent_->poll())
+            cancel(parent_->reason());
+        if (stopped() || (polls_.fetch_add(1, std::memory_order_relaxed) & 255) != 0)
+            return stopped();
+        if (max_seconds > 0 && elapsed() > max_seconds)
+            cancel(stop_reason::time);
+        if (max_kib > 0 && peak_kib() > max_kib)
+            cancel(stop_reason::memory);
+        return stopped();
+    }
+
+    /// Throws stop_error if the flag is set (outside of any parallel
+    /// region).
+    void check()
+    {
+        poll();
+        if (stopped())
+            throw stop_error(reason());
+    }
+
+    /// Check the number of states of an exploration.
+    void check_states(std::size_t n)
+    {
+        if (max_states > 0 && n > max_states)
+            cancel(stop_reason::size);
+        check();
+    }
+
+    double elapsed() const
+    {
+        std::chrono::duration<double> d = std::chrono::steady_clock::now() - start_;
+        return d.count();
+    }
+
+    /// The stream of the log lines (std::cout by default).
+    std::ostream& log() const
+    {
+        return *log_;
+    }
+
+    void set_log(std::ostream& out)
+    {
+        log_ = &out;
+    }
+
+    static std::size_t peak_kib()
+    {
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+        return ru.ru_maxrss / 1024;
+#else
+        return ru.ru_maxrss;
+#endif
+    }
+
+    double max_seconds;
+    std::size_t max_kib;
+    std::size_t max_states;
+
+private:
+    std::chrono::steady_clock::time_point start_;
+    std::atomic<int> reason_{0};
+    std::atomic<unsigned> polls_{0};
+    exec_context* parent_ = nullptr;
+    std::ostream* log_ = &std::cout;
+};
+
+/// Run the body of a tool: SIGINT and SIGTERM stop it cleanly, and a
+/// stop (signal or budget) calls on_stop, if any (e.g. to save a
+/// checkpoint, see walnut.hh), and gives the exit status of the reason.
+inline int run_tool(const std::function<int()>& body,
+                    const std::function<void()>& on_stop = nullptr)
+{
+    install_signal_handlers();
+    try {
+        return body();
+    } catch (const stop_error& e) {
+        std::cout << std::endl;
+        std::cerr << "stopped: " << e.what() << std::endl;
+        if (on_stop)
+            on_stop();
+        return exit_status(e.reason);
+    }
+}
+
+}
+}
+
+#endif
@@ -0,0 +1,664 @@
+#ifndef ABCOMP_DFAO_HH
+#define ABCOMP_DFAO_HH
+
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <numeric>
+#include <ostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "context.hh"
+
+namespace dfa {
+
+struct VectorHash {
+    std::size_t operator()(const std::vector<int>& v) const {
+        std::size_t hash = 0;
+        for (int i : v) {
+            hash ^= std::hash<int> {}(i) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        }
+        return hash;
+    }
+};
+
+struct LabelMapper {
+public:
+    std::unordered_map<std::vector<int>, int, VectorHash> to_int;
+    std::vector<std::vector<int>> to_tuple;
+
+    int get(const std::vector<int>& tuple) {
+        auto it = to_int.find(tuple);
+        if (it != to_int.end())
+            return it->second;
+
+        int id = static_cast<int>(to_tuple.size());
+        to_tuple.push_back(tuple);
+        to_int[tuple] = id;
+        return id;
+    }
+
+    const std::vector<int>& operator[](int id) const {
+        return to_tuple[id];
+    }
+
+    int size() const {
+        return static_cast<int>(to_tuple.size());
+    }
+
+    std::set<int> labels_set() const {
+        std::set<int> res;
+        for (int i = 0; i < size(); ++i)
+            res.insert(i);
+        return res;
+    }
+
+    std::vector<int> labels() const {
+        std::vector<int> res(size());
+        std::iota(res.begin(), res.end(), 0);
+        std::sort(res.begin(), res.end(), [&](int a, int b) {
+            return to_tuple[a] < to_tuple[b];
+        });
+        return res;
+    }
+};
+
+inline void dfa_from_walnut(
+    const std::string& filename,
+    std::vector<std::map<std::vector<int>, int>>& trans,
+    std::vector<int>& out,
+    LabelMapper& label_mapper
+) {
+    std::ifstream in(filename);
+    if (!in)
+        throw std::runtime_error("Cannot open file: " + filename);
+
+    std::string line;
+    std::getline(in, line);
+
+    int current_state = -1;
+    std::map<std::vector<int>, int> current_trans;
+
+    while (std::getline(in, line)) {
+        std::stringstream ss(line);
+        std::string s = line;
+        if (s.empty()) continue;
+
+        auto pos = s.find("->");
+        if (pos == std::string::npos) {
+            if (current_state != -1)
+                trans[current_state] = current_trans;
+            current_trans.clear();
+
+            std::stringstream st_line(s);
+            int q, o;
+            st_line >> q >> o;
+            current_state = q;
+            if (q >= (int)out.size())
+                out.resize(q + 1);
+            out[q] = o;
+            if (q >= (int)trans.size())
+                trans.resize(q + 1);
+        } else {
+            std::string left = s.substr(0, pos);
+            std::string right = s.substr(pos + 2);
+            std::stringstream left_ss(left);
+            std::vector<int> label;
+            int val;
+            while (left_ss >> val)
+                label.push_back(val);
+            int target = std::stoi(right);
+            current_trans[label] = target;
+            label_mapper.get(label);
+        }
+    }
+
+    if (current_state != -1)
+        trans[current_state] = current_trans;
+}
+
+inline std::vector<int> digits_of(const LabelMapper& al) {
+    std::set<int> d;
+    for (const auto& t : al.to_tuple)
+        d.insert(t.begin(), t.end());
+    return std::vector<int>(d.begin(), d.end());
+}
+
+/// A DFA read by dfa_from_walnut as a dense table, for the product
+/// walks: a letter (d_0, ..., d_{r-1}) over the digits 0..base-1 is
+/// the code d_0 + d_1.base + ... + d_{r-1}.base^{r-1}, and a missing
+/// transition is -1.  The initial state is 0.  With the outputs, it is
+/// a DFAO as well.
+struct dfa_table {
+    int arity = 0;
+    int base = 0;
+    int letters = 0;
+    std::vector<int> out;
+    std::vector<int> next;
+
+    dfa_table() = default;
+
+    /// No state, arity tracks over the digits 0..base-1.
+    dfa_table(int arity_, int base_)
+        : arity(arity_), base(base_), letters(1)
+    {
+        for (int t = 0; t < arity; ++t)
+            letters *= base;
+    }
+
+    dfa_table(const std::vector<std::map<std::vector<int>, int>>& trans,
+              const std::vector<int>& out_, int base_)
+        : base(base_), out(out_)
+    {
+        for (const auto& m : trans)
+            if (!m.empty()) {
+                arity = m.begin()->first.size();
+                break;
+            }
+        letters = 1;
+        for (int t = 0; t < arity; ++t)
+            letters *= base;
+        out.resize(trans.size());
+        next.assign(trans.size() * letters, -1);
+        for (size_t q = 0; q < trans.size(); ++q)
+            for (const auto& [a, p] : trans[q])
+                next[q * letters + code(a)] = p;
+    }
+
+    int code(const std::vector<int>& a) const {
+        return code(a.data());
+    }
+
+    /// The letter of the digits a[0], ..., a[arity - 1].
+    int code(const int* a) const {
+        int c = 0;
+        for (int t = arity; t-- > 0;)
+            c = c * base + a[t];
+        return c;
+    }
+
+    /// The digit of track t in the letter c.
+    int digit(int c, int t) const {
+        while (t-- > 0)
+            c /= base;
+        return c % base;
+    }
+
+    int operator()(int q, int c) const {
+        return q < 0 ? -1 : next[size_t(q) * letters + c];
+    }
+
+    bool accepts(int q) const {
+        return q >= 0 && out[q] > 0;
+    }
+
+    size_t size() const {
+        return out.size();
+    }
+
+    /// A new state with output o and no transition.
+    int add_state(int o) {
+        out.push_back(o);
+        next.resize(next.size() + letters, -1);
+        return out.size() - 1;
+    }
+};
+
+/*
+  Pointwise arithmetic on automatic sequences given by DFAOs over the
+  same tracks (msd first, as Walnut's): the product of two DFAOs
+  computes op of their outputs, and a track can be fixed to a value.
+  Every result is reachable and minimized (Moore's refinement, with
+  the signatures of the states computed in parallel), so that the
+  next product starts from the smallest automata.  A missing
+  transition (an invalid input) stays missing.
+*/
+
+/// The minimal DFAO of a: the reachable states, by breadth first
+/// order, and merged by Moore's refinement.
+inline dfa_table minimize(const dfa_table& a,
+                          awali::sttc::exec_context& ctx = awali::sttc::exec_context::global()) {
+    dfa_table res(a.arity, a.base);
+    if (a.size() == 0)
+        return res;
+    // reachable states
+    std::vector<int> order{0}, index(a.size(), -1);
+    index[0] = 0;
+    for (size_t i = 0; i < order.size(); ++i)
+        for (int c = 0; c < a.letters; ++c) {
+            int p = a(order[i], c);
+            if (p >= 0 && index[p] < 0) {
+                index[p] = order.size();
+                order.push_back(p);
+            }
+        }
+    size_t n = order.size();
+    // classes by output, then by the classes of the successors
+    std::vector<int> cls(n), sig_cls(n);
+    std::map<int, int> by_out;
+    for (size_t i = 0; i < n; ++i)
+        cls[i] = by_out.emplace(a.out[order[i]], by_out.size()).first->second;
+    size_t classes = by_out.size();
+    std::vector<std::vector<int>> sig(n);
+    while (true) {
+        ctx.check();
+        #pragma omp parallel for schedule(dynamic, 256)
+        for (size_t i = 0; i < n; ++i) {
+            auto& s = sig[i];
+            s.assign(1, cls[i]);
+            for (int c = 0; c < a.letters; ++c) {
+                int p = a(order[i], c);
+                s.push_back(p < 0 ? -1 : cls[index[p]]);
+            }
+        }
+        std::map<std::vector<int>, int> ids;
+        for (size_t i = 0; i < n; ++i)
+            sig_cls[i] = ids.emplace(sig[i], ids.size()).first->second;
+        cls.swap(sig_cls);
+        if (ids.size() == classes)
+            break;
+        classes = ids.size();
+    }
+    // the class of the initial state first, in breadth first order
+    std::vector<int> rename(classes, -1), repr;
+    for (size_t i = 0; i < n; ++i)
+        if (rename[cls[i]] < 0) {
+            rename[cls[i]] = repr.size();
+            repr.push_back(order[i]);
+            res.add_state(a.out[order[i]]);
+        }
+    for (size_t q = 0; q < repr.size(); ++q)
+        for (int c = 0; c < a.letters; ++c) {
+            int p = a(repr[q], c);
+            if (p >= 0)
+                res.next[q * res.letters + c] = rename[cls[index[p]]];
+        }
+    return res;
+}
+
+/// The DFAO of op(a(x), b(x)), minimized.
+inline dfa_table product(const dfa_table& a, const dfa_table& b,
+                         const std::function<int(int, int)>& op,
+                         awali::sttc::exec_context& ctx = awali::sttc::exec_context::global()) {
+    if (a.arity != b.arity || a.base != b.base)
+        throw std::invalid_argument("product of DFAOs on different tracks");
+    dfa_table res(a.arity, a.base);
+    if (a.size() == 0 || b.size() == 0)
+        return res;
+    std::unordered_map<long long, int> states;
+    std::deque<std::pair<int, int>> todo;
+    auto get = [&](int p, int q) {
+        long long k = (long long)p * b.size() + q;
+        auto it = states.find(k);
+        if (it != states.end())
+            return it->second;
+        int s = res.add_state(op(a.out[p], b.out[q]));
+        states.emplace(k, s);
+        todo.emplace_back(p, q);
+        return s;
+    };
+    get(0, 0);
+    for (int s = 0; !todo.empty(); ++s) {
+        ctx.check();
+        auto [p, q] = todo.front();
+        todo.pop_front();
+        for (int c = 0; c < a.letters; ++c) {
+            int pp = a(p, c), qq = b(q, c);
+            if (pp >= 0 && qq >= 0) {
+                int d = get(pp, qq);
+                res.next[size_t(s) * res.letters + c] = d;
+            }
+        }
+    }
+    return minimize(res, ctx);
+}
+
+/// The DFAO of f(a(x)), minimized.
+inline dfa_table map_outputs(const dfa_table& a, const std::function<int(int)>& f,
+                             awali::sttc::exec_context& ctx = awali::sttc::exec_context::global()) {
+    dfa_table res = a;
+    for (auto& o : res.out)
+        o = f(o);
+    return minimize(res, ctx);
+}
+
+/*
+  The DFAO of the other tracks when track t is rep (msd first, without
+  leading zeros).  The fixed track is 0*rep, aligned on the right: a
+  state is the tuple of the states of a after reading the current word
+  with 0...0rep[0..p) on the fixed track, for p = 0..|rep| (-1 if the
+  word is shorter than p), and its output is the one of p = |rep|.
+  The initial state reads |rep| zeros first (leading zeros do not
+  change the values), so that this state is always defined.
+*/
+inline dfa_table fix_track(const dfa_table& a, int t, const std::vector<int>& rep,
+                           awali::sttc::exec_context& ctx = awali::sttc::exec_context::global()) {
+    dfa_table res(a.arity - 1, a.base);
+    size_t l = rep.size();
+    // code in a of the letter c of res with d on track t
+    std::vector<int> lift(size_t(res.letters) * a.base);
+    for (int c = 0; c < res.letters; ++c)
+        for (int d = 0; d < a.base; ++d) {
+            std::vector<int> digits;
+            for (int u = 0; u < res.arity; ++u)
+                digits.push_back(res.digit(c, u));
+            digits.insert(digits.begin() + t, d);
+            lift[size_t(c) * a.base + d] = a.code(digits);
+        }
+    using tuple_t = std::vector<int>;
+    auto step = [&](const tuple_t& s, int c) {
+        tuple_t r(l + 1, -1);
+        r[0] = a(s[0], lift[size_t(c) * a.base]);
+        for (size_t p = 1; p <= l; ++p)
+            r[p] = a(s[p - 1], lift[size_t(c) * a.base + rep[p - 1]]);
+        return r;
+    };
+    auto dead = [](const tuple_t& s) {
+        for (int q : s)
+            if (q >= 0)
+                return false;
+        return true;
+    };
+    tuple_t init(l + 1, -1);
+    init[0] = 0;
+    for (size_t i = 0; i < l; ++i)
+        init = step(init, 0);
+    if (a.size() == 0 || init[l] < 0)
+        return res;
+    std::map<tuple_t, int> states;
+    std::deque<const tuple_t*> todo;
+    auto get = [&](tuple_t&& s) {
+        auto it = states.find(s);
+        if (it != states.end())
+            return it->second;
+        int q = res.add_state(s[l] < 0 ? 0 : a.out[s[l]]);
+        it = states.emplace(std::move(s), q).first;
+        todo.push_back(&it->first);
+        return q;
+    };
+    get(std::move(init));
+    for (int q = 0; !todo.empty(); ++q) {
+        ctx.check();
+        const tuple_t& s = *todo.front();
+        todo.pop_front();
+        for (int c = 0; c < res.letters; ++c) {
+            tuple_t r = step(s, c);
+            if (!dead(r)) {
+                int d = get(std::move(r));
+                res.next[size_t(q) * res.letters + c] = d;
+            }
+        }
+    }
+    return minimize(res, ctx);
+}
+
+/// The msd representations of 0..count-1 in the numeration system of
+/// the DFA valid (one track): the valid words without leading zeros,
+/// by length then lexicographically, as the values of the numeration
+/// systems of Walnut increase in this order.
+inline std::vector<std::vector<int>> representations(const dfa_table& valid, size_t count) {
+    std::vector<std::vector<int>> res;
+    if (count == 0)
+        return res;
+    res.emplace_back();
+    // the words of the current length, with their states
+    std::vector<std::pair<std::vector<int>, int>> words{{{}, 0}};
+    while (res.size() < count && !words.empty()) {
+        std::vector<std::pair<std::vector<int>, int>> longer;
+        for (const auto& [w, q] : words)
+            for (int d = w.empty() ? 1 : 0; d < valid.base; ++d) {
+                int p = valid(q, d);
+                if (p < 0)
+                    continue;
+                auto v = w;
+                v.push_back(d);
+                if (valid.accepts(p) && res.size() < count)
+                    res.push_back(v);
+                longer.emplace_back(std::move(v), p);
+            }
+        words.swap(longer);
+    }
+    if (res.size() < count)
+        throw std::runtime_error("the numeration system has less than "
+                                 + std::to_string(count) + " numbers");
+    return res;
+}
+
+/*
+  The msd representation of the integer x in the numeration system of
+  the DFA valid (one track): the x-th valid word without leading zeros
+  in radix order, as in representations, but found digit by digit
+  with the number of accepted words of each length from each state,
+  so that x can be large.  The counts saturate, and are extended to
+  longer words when needed.
+*/
+class representation {
+public:
+    explicit representation(const dfa_table& valid)
+        : valid_(valid)
+    {
+        if (valid_.arity != 1)
+            throw std::invalid_argument("a numeration system has one track");
+        words_.emplace_back(valid_.size());
+        for (size_t q = 0; q < valid_.size(); ++q)
+            words_[0][q] = valid_.accepts(q) ? 1 : 0;
+    }
+
+    int base() const {
+        return valid_.base;
+    }
+
+    /// Throws if there are less than x+1 valid words.
+    std::vector<int> operator()(unsigned long long x) {
+        std::vector<int> res(length(x));
+        unrank(x, res.data());
+        return res;
+    }
+
+    /// The length of the representation of x.  The counts are extended
+    /// up to it, so that unrank(y) is then const for every y <= x.
+    /// Throws if there are less than x+1 valid words.
+    size_t length(unsigned long long x) {
+        const unsigned long long value = x;
+        if (valid_.size() == 0)
+            throw std::runtime_error("empty numeration system");
+        if (valid_.accepts(0)) {
+            if (x == 0)
+                return 0;
+            --x;
+        }
+        for (size_t l = 1;; ++l) {
+            unsigned long long c = first_digit_words(l);
+            if (x < c)
+                return l;
+            x -= c;
+            if (l > 64 * size_t(valid_.size()) && c == 0)
+                throw std::runtime_error("no representation of " + std::to_string(value));
+        }
+    }
+
+    /// Writes the representation of x in res, and returns its length.
+    /// The counts must have been extended by length(y) for some y >= x.
+    size_t unrank(unsigned long long x, int* res) const {
+        if (valid_.accepts(0)) {
+            if (x == 0)
+                return 0;
+            --x;
+        }
+        size_t l = 1;
+        for (;; ++l) {
+            unsigned long long c = first_words(l);
+            if (x < c)
+                break;
+            x -= c;
+        }
+        int q = 0;
+        size_t n = 0;
+        for (size_t p = l; p-- > 0;)
+            for (int d = n == 0 ? 1 : 0; d < valid_.base; ++d) {
+                int r = valid_(q, d);
+                if (r < 0)
+                    continue;
+                unsigned long long c = words_[p][r];
+                if (x < c) {
+                    res[n++] = d;
+                    q = r;
+                    break;
+                }
+                x -= c;
+            }
+        return n;
+    }
+
+    const dfa_table& valid() const {
+        return valid_;
+    }
+
+    /// words(l)[q]: the accepted words of length l from q (saturated).
+    const std::vector<unsigned long long>& words(size_t l) {
+        while (words_.size() <= l) {
+            const auto& prev = words_.back();
+            std::vector<unsigned long long> cur(valid_.size(), 0);
+            for (size_t q = 0; q < valid_.size(); ++q)
+                for (int d = 0; d < valid_.base; ++d) {
+                    int r = valid_(q, d);
+                    if (r >= 0)
+                        cur[q] = add(cur[q], prev[r]);
+                }
+            words_.push_back(std::move(cur));
+        }
+        return words_[l];
+    }
+
+    /// The accepted words of length l without leading zeros.
+    unsigned long long first_digit_words(size_t l) {
+        words(l - 1);
+        return first_words(l);
+    }
+
+private:
+    /// first_digit_words(l), once the counts are extended to l - 1.
+    unsigned long long first_words(size_t l) const {
+        const auto& w = words_[l - 1];
+        unsigned long long c = 0;
+        for (int d = 1; d < valid_.base; ++d) {
+            int r = valid_(0, d);
+            if (r >= 0)
+                c = add(c, w[r]);
+        }
+        return c;
+    }
+
+    static unsigned long long add(unsigned long long a, unsigned long long b) {
+        return a > ~0ULL - b ? ~0ULL : a + b;
+    }
+
+    dfa_table valid_;
+    std::vector<std::vector<unsigned long long>> words_;
+};
+
+/// Reads a DFAO in Walnut's format from the text [first, last) (a
+/// mapped file, for instance), over the digits 0..base-1 (by default,
+/// up to the largest digit of the transitions).
+inline dfa_table dfao_from_walnut(const char* first, const char* last, int base = 0) {
+    struct edge {
+        int src, dst;
+        std::vector<int> digits;
+    };
+    std::vector<edge> edges;
+    std::vector<int> out;
+    int arity = -1, q = -1;
+    auto number = [&](const char*& p) {
+        while (p < last && (*p == ' ' || *p == '\t' || *p == '\r'))
+            ++p;
+        if (p == last || !(std::isdigit(static_cast<unsigned char>(*p)) || *p == '-'))
+            return false;
+        return true;
+    };
+    auto read = [&](const char*& p) {
+        bool neg = *p == '-';
+        if (neg)
+            ++p;
+        long v = 0;
+        while (p < last && std::isdigit(static_cast<unsigned char>(*p)))
+            v = v * 10 + (*p++ - '0');
+        return int(neg ? -v : v);
+    };
+    const char* p = std::find(first, last, '\n');  // the numeration systems
+    while (p < last) {
+        const char* eol = std::find(p + 1, last, '\n');
+        const char* arrow = std::search(p, eol, "->", "->" + 2);
+        const char* s = p + (*p == '\n');
+        if (arrow != eol) {
+            if (q < 0)
+                throw std::runtime_error("walnut: transition before any state");
+            edge e{q, -1, {}};
+            while (number(s) && s < arrow)
+                e.digits.push_back(read(s));
+            s = arrow + 2;
+            if (!number(s))
+                throw std::runtime_error("walnut: transition without target");
+            e.dst = read(s);
+            if (arity >= 0 && arity != int(e.digits.size()))
+                throw std::runtime_error("walnut: transitions of different arities");
+            arity = e.digits.size();
+            for (int d : e.digits)
+                base = std::max(base, d + 1);
+            edges.push_back(std::move(e));
+        } else if (number(s)) {
+            q = read(s);
+            if (!number(s))
+                throw std::runtime_error("walnut: state without output");
+            if (q >= int(out.size()))
+                out.resize(q + 1, 0);
+            out[q] = read(s);
+        }
+        p = eol;
+    }
+    dfa_table res(std::max(arity, 0), std::max(base, 1));
+    for (int o : out)
+        res.add_state(o);
+    for (const auto& e : edges) {
+        if (e.dst < 0 || e.dst >= int(res.size()))
+            throw std::runtime_error("walnut: transition to an unknown state");
+        res.next[size_t(e.src) * res.letters + res.code(e.digits)] = e.dst;
+    }
+    return res;
+}
+
+/// Writes a in Walnut's format, the letters in lexicographic order.
+inline void dfao_to_walnut(const dfa_table& a, std::ostream& out, const std::string& ns) {
+    for (int t = 0; t < a.arity; ++t)
+        out << ns << (t + 1 == a.arity ? "\n" : " ");
+    std::vector<std::vector<int>> tuples;
+    for (int i = 0; i < a.letters; ++i) {
+        std::vector<int> d(a.arity);
+        for (int t = a.arity, x = i; t-- > 0; x /= a.base)
+            d[t] = x % a.base;
+        tuples.push_back(d);
+    }
+    for (size_t q = 0; q < a.size(); ++q) {
+        out << "\n" << q << " " << a.out[q] << "\n";
+        for (const auto& d : tuples) {
+            int p = a(q, a.code(d));
+            if (p < 0)
+                continue;
+            for (int t = 0; t < a.arity; ++t)
+                out << (t > 0 ? " " : "") << d[t];
+            out << " -> " << p << "\n";
+        }
+    }
+}
+
+}  // namespace dfa
+
+#endif
@@ -0,0 +1,268 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cctype>
+#include <cstdint>
+
+#include "dfao.hh"
+
+
+using namespace std;
+using namespace awali::sttc;
+using namespace dfa;
+
+auto now() {
+    return chrono::steady_clock::now();
+}
+
+void log_duration(const std::string& label, std::chrono::steady_clock::time_point start) {
+    using namespace std;
+    auto end = chrono::steady_clock::now();
+    auto duration_ms = chrono::duration_cast<chrono::milliseconds>(end - start).count();
+
+    long long total_seconds = duration_ms / 1000;
+
+    cout << label << " ";
+
+    if (total_seconds < 60) {
+        // Format : 4.321s
+        cout << fixed << setprecision(3) << (duration_ms / 1000.0) << "s";
+    } else {
+        int hours = static_cast<int>(total_seconds / 3600);
+        int minutes = static_cast<int>((total_seconds % 3600) / 60);
+        int seconds = static_cast<int>(total_seconds % 60);
+
+        if (hours > 0)
+            cout << hours << ":" << setfill('0') << setw(2);
+        cout << minutes << ":" << setfill('0') << setw(2) << seconds;
+    }
+
+    cout << endl << endl;
+}
+
+/// The smallest unsigned type for the numbers 0..n.
+string state_type(size_t n) {
+    return n <= 0xff ? "std::uint8_t" : n <= 0xffff ? "std::uint16_t" : "std::uint32_t";
+}
+
+/// The elements of v, on the line if there are at most 16, else 16 per
+/// line.
+template<typename T>
+void write_list(ostream& out, const vector<T>& v, const string& indent) {
+    if (v.size() <= 16) {
+        for (size_t i = 0; i < v.size(); ++i)
+            out << (i > 0 ? ", " : "") << v[i];
+        return;
+    }
+    for (size_t i = 0; i < v.size(); ++i)
+        out << (i % 16 == 0 ? "\n" + indent : " ") << v[i] << (i + 1 < v.size() ? "," : "");
+    out << "\n";
+}
+
+/// The transitions of a with the missing ones to a sink, the state
+/// a.size() (a loop).
+vector<unsigned> with_sink(const dfa_table& a) {
+    vector<unsigned> res;
+    for (size_t q = 0; q <= a.size(); ++q)
+        for (int c = 0; c < a.letters; ++c) {
+            int p = q < a.size() ? a(q, c) : -1;
+            res.push_back(p < 0 ? a.size() : p);
+        }
+    return res;
+}
+
+/*
+  A C++ header for a fixed DFAO, without any dependency: the minimal
+  DFAO and the DFA of the numeration system as constexpr tables, with
+  a sink for the missing transitions (so that the walk has no test),
+  and the numbers of valid words of each length from each state, to
+  compute the representations digit by digit as representation in
+  dfao.hh.  The lengths go up to the first one where every uint64_t
+  has a representation.
+*/
+int main(int argc, char** argv) {
+    long long missing = 0;
+    int a = 1;
+    if (argc == 6 && string(argv[1]) == "-m") {
+        missing = stoll(argv[2]);
+        a = 3;
+    }
+    if (argc != a + 3) {
+        cerr << "Usage: " << argv[0] << " [-m missing] dfao.txt ns output.hh\n"
+             << "  where dfao.txt is a DFAO of Walnut and ns.txt its numeration system (msd_foo)\n"
+             << "  Output: a header with the function value(std::array<std::uint64_t, r>)\n"
+             << "  (r the number of tracks) in the namespace of the name of output.hh; missing\n"
+             << "  (0 by default) is the value of the undefined paths\n";
+        return 1;
+    }
+
+    string input = argv[a];
+    string ns = argv[a + 1];
+    string output = argv[a + 2];
+    string name = output.substr(output.find_last_of('/') + 1);
+    name = name.substr(0, name.find('.'));
+    for (auto& c : name)
+        if (!isalnum(static_cast<unsigned char>(c)))
+            c = '_';
+    if (name.empty() || isdigit(static_cast<unsigned char>(name[0])))
+        name = "dfao_" + name;
+    string guard = name;
+    for (auto& c : guard)
+        c = toupper(static_cast<unsigned char>(c));
+    guard += "_HH";
+
+    return run_tool([&]() {
+        vector<map<vector<int>,int>> trans, valid;
+        vector<int> trans_out, valid_out;
+        LabelMapper transmap, validmap;
+
+        cout << "* Chargement de " << input << " et " << ns << endl;
+        auto t0 = now();
+        dfa_from_walnut(input, trans, trans_out, transmap);
+        dfa_from_walnut(ns + ".txt", valid, valid_out, validmap);
+        int base = 0;
+        for (const auto* m : {&transmap, &validmap})
+            for (int d : digits_of(*m))
+                base = max(base, d + 1);
+        dfa_table D(trans, trans_out, base), V(valid, valid_out, base);
+        if (V.arity != 1)
+            throw runtime_error("unexpected number of tracks in " + ns);
+        D = minimize(D);
+        V = minimize(V);
+        if (D.size() == 0 || V.size() == 0)
+            throw runtime_error("empty automaton");
+        cout << D.size() << " states, " << D.arity << " track(s) (minimal)" << endl;
+        log_duration(">>>", t0);
+
+        cout << "Longueurs" << endl;
+        t0 = now();
+        representation rep(V);
+        // first[l]: the numbers with l digits, up to the length where
+        // the count of the numbers saturates
+        const size_t max_cap = 1024;
+        unsigned long long total = V.accepts(0) ? 1 : 0;
+        vector<unsigned long long> first{0};
+        while (total != ~0ULL && first.size() <= max_cap) {
+            unsigned long long c = rep.first_digit_words(first.size());
+            first.push_back(c);
+            total = total > ~0ULL - c ? ~0ULL : total + c;
+        }
+        size_t max_length = first.size() - 1;
+        cout << max_length << " digits at most" << endl;
+        log_duration(">>>", t0);
+
+        cout << "Écriture de la sortie" << endl;
+        t0 = now();
+        ofstream out(output);
+        if (!out)
+            throw runtime_error("Cannot open file: " + output);
+        out << "// Generated by dfao2cc from " << input << " in " << ns << ": do not edit.\n"
+            << "#ifndef " << guard << "\n#define " << guard << "\n\n"
+            << "#include <array>\n#include <cstddef>\n#include <cstdint>\n\n"
+            << "namespace " << name << " {\n\n";
+
+        out << "/// The numeration system " << ns << ": valid_next[q * base + d] is the\n"
+            << "/// state after the digit d (valid_states is a sink), words[l][q] the\n"
+            << "/// number of valid words of length l from q, and first_words[l] the\n"
+            << "/// number of representations of length l (saturated).\n"
+            << "inline constexpr int base = " << base << ";\n"
+            << "inline constexpr int max_length = " << max_length << ";\n"
+            << "inline constexpr bool empty_valid = " << (V.accepts(0) ? "true" : "false") << ";\n"
+            << "inline constexpr int valid_states = " << V.size() << ";\n"
+            << "inline constexpr " << state_type(V.size()) << " valid_next[] = {";
+        write_list(out, with_sink(V), "    ");
+        out << "};\ninline constexpr std::uint64_t words[max_length][valid_states + 1] = {";
+        for (size_t l = 0; l < max_length; ++l) {
+            vector<string> row;
+            for (auto c : rep.words(l))
+                row.push_back(to_string(c) + "u");
+            row.push_back("0u");
+            out << "\n    {";
+            write_list(out, row, "        ");
+            out << (row.size() > 16 ? "    }" : "}") << (l + 1 < max_length ? "," : "");
+        }
+        out << "\n};\ninline constexpr std::uint64_t first_words[max_length + 1] = {";
+        vector<string> fw;
+        for (auto c : first)
+            fw.push_back(to_string(c) + "u");
+        write_list(out, fw, "    ");
+        out << "};\n\n";
+
+        vector<long long> outputs(D.out.begin(), D.out.end());
+        outputs.push_back(missing);
+        out << "/// The DFAO: next[q * letters + c] for the letter c = d_0 + d_1.base\n"
+            << "/// + ... of the digits d_t of the tracks, with the sink states, of\n"
+            << "/// output " << missing << " (undefined paths).\n"
+            << "inline constexpr int arity = " << D.arity << ";\n"
+            << "inline constexpr int letters = " << D.letters << ";\n"
+            << "inline constexpr int states = " << D.size() << ";\n"
+            << "inline constexpr " << state_type(D.size()) << " next[] = {";
+        write_list(out, with_sink(D), "    ");
+        out << "};\ninline constexpr std::int64_t out[] = {";
+        write_list(out, outputs, "    ");
+        out << "};\n\n";
+
+        out << R"(/// The msd representation of x without leading zeros, aligned on the
+/// right of d (the other digits are left unchanged): its length, or -1
+/// if it is longer than max_length.
+constexpr int digits(std::uint64_t x, std::uint8_t (&d)[max_length]) {
+    if (empty_valid) {
+        if (x == 0)
+            return 0;
+        --x;
+    }
+    int l = 1;
+    for (; l <= max_length && x >= first_words[l]; ++l)
+        x -= first_words[l];
+    if (l > max_length)
+        return -1;
+    int q = 0;
+    for (int p = l - 1; p >= 0; --p) {
+        int c = p == l - 1 ? 1 : 0;
+        for (;; ++c) {
+            int r = valid_next[q * base + c];
+            if (x < words[p][r]) {
+                q = r;
+                break;
+            }
+            x -= words[p][r];
+        }
+        d[max_length - 1 - p] = c;
+    }
+    return l;
+}
+
+/// The output of the DFAO on the tracks x (padded with leading zeros).
+template<std::size_t R>
+constexpr std::int64_t value(const std::array<std::uint64_t, R>& x) {
+    static_assert(R == arity, "wrong number of tracks");
+    std::uint8_t d[R > 0 ? R : 1][max_length] = {};
+    int len = 0;
+    for (std::size_t t = 0; t < R; ++t) {
+        int l = digits(x[t], d[t]);
+        if (l < 0)
+            return out[states];
+        len = l > len ? l : len;
+    }
+    int q = 0;
+    for (int p = max_length - len; p < max_length; ++p) {
+        int c = 0;
+        for (std::size_t t = R; t-- > 0;)
+            c = c * base + d[t][p];
+        q = next[q * letters + c];
+    }
+    return out[q];
+}
+)";
+        if (D.arity == 1)
+            out << "\nconstexpr std::int64_t value(std::uint64_t x) {\n"
+                << "    return value<1>({x});\n}\n";
+        out << "\n}  // namespace " << name << "\n\n#endif\n";
+        log_duration(">>>", t0);
+
+        return 0;
+    });
+}
@@ -0,0 +1,141 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <exception>
+
+#include "dfao.hh"
+
+
+using namespace std;
+using namespace awali::sttc;
+using namespace dfa;
+
+auto now() {
+    return chrono::steady_clock::now();
+}
+
+void log_duration(const std::string& label, std::chrono::steady_clock::time_point start) {
+    using namespace std;
+    auto end = chrono::steady_clock::now();
+    auto duration_ms = chrono::duration_cast<chrono::milliseconds>(end - start).count();
+
+    long long total_seconds = duration_ms / 1000;
+
+    cout << label << " ";
+
+    if (total_seconds < 60) {
+        // Format : 4.321s
+        cout << fixed << setprecision(3) << (duration_ms / 1000.0) << "s";
+    } else {
+        int hours = static_cast<int>(total_seconds / 3600);
+        int minutes = static_cast<int>((total_seconds % 3600) / 60);
+        int seconds = static_cast<int>(total_seconds % 60);
+
+        if (hours > 0)
+            cout << hours << ":" << setfill('0') << setw(2);
+        cout << minutes << ":" << setfill('0') << setw(2) << seconds;
+    }
+
+    cout << endl << endl;
+}
+
+/// Runs body(t) for t in [from, to) in parallel; the first exception
+/// (a stop in particular) is rethrown after the loop.
+void parallel_for(size_t from, size_t to, const function<void(size_t)>& body) {
+    exception_ptr error;
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (size_t t = from; t < to; ++t) {
+        try {
+            body(t);
+        } catch (...) {
+            #pragma omp critical
+            if (!error)
+                error = current_exception();
+        }
+    }
+    if (error)
+        rethrow_exception(error);
+}
+
+/*
+  abcomp(k,n) = 1 + Diffabeq[0][n] + ... + Diffabeq[k-1][n], as the
+  abeq{k} predicates of genabeqk.py, but on DFAOs: D_t = Diffabeq[t][.]
+  is Diffabeq with its first track fixed to t, and the partial sums are
+  products of DFAOs, minimized after each step (dfao.hh).  The D_t are
+  computed in parallel, and the partial sums with a parallel prefix
+  sum: log2(K) rounds of independent products.
+*/
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        cerr << "Usage: " << argv[0] << " ns K\n"
+             << "  where ns is a numeration system and Diffabeq[ns].txt (from difffirst)\n"
+             << "  and msd_[ns].txt are the input\n"
+             << "  Output: Kabcomp[k][ns].txt, the DFAO of n -> abcomp(k,n), for k = 1..K\n";
+        return 1;
+    }
+
+    string dt = argv[1];
+    string ns = "msd_" + dt;
+    size_t K = stoul(argv[2]);
+
+    return run_tool([&]() {
+        vector<map<vector<int>,int>> diff, valid;
+        vector<int> diff_out, valid_out;
+        LabelMapper diffmap, validmap;
+
+        cout << "* Chargement de Diffabeq" << dt << " et " << ns << endl;
+        auto t0 = now();
+        dfa_from_walnut("Diffabeq" + dt + ".txt", diff, diff_out, diffmap);
+        dfa_from_walnut(ns + ".txt", valid, valid_out, validmap);
+        int base = 0;
+        for (const auto* m : {&diffmap, &validmap})
+            for (int d : digits_of(*m))
+                base = max(base, d + 1);
+        dfa_table D(diff, diff_out, base), V(valid, valid_out, base);
+        if (D.arity != 2 || V.arity != 1)
+            throw runtime_error("unexpected number of tracks");
+        D = minimize(D);
+        cout << D.size() << " states (minimal)" << endl;
+        log_duration(">>>", t0);
+
+        cout << "Fixation de k" << endl;
+        t0 = now();
+        auto reps = representations(V, K);
+        vector<dfa_table> S(K);
+        parallel_for(0, K, [&](size_t t) {
+            S[t] = fix_track(D, 0, reps[t]);
+        });
+        S[0] = map_outputs(S[0], [](int x) { return x + 1; });
+        for (size_t t = 0; t < K; ++t)
+            cout << "Diffabeq" << dt << "[" << t << "]: " << S[t].size() << " states" << endl;
+        log_duration(">>>", t0);
+
+        cout << "Sommes partielles" << endl;
+        t0 = now();
+        auto plus = [](int x, int y) { return x + y; };
+        for (size_t off = 1; off < K; off *= 2) {
+            vector<dfa_table> prev = S;
+            parallel_for(off, K, [&](size_t t) {
+                S[t] = product(prev[t - off], prev[t], plus);
+            });
+        }
+        log_duration(">>>", t0);
+
+        cout << "Écriture de la sortie" << endl;
+        t0 = now();
+        for (size_t k = 1; k <= K; ++k) {
+            string name = "Kabcomp" + to_string(k) + dt + ".txt";
+            ofstream fout(name);
+            if (!fout)
+                throw runtime_error("Cannot open file: " + name);
+            dfao_to_walnut(S[k - 1], fout, ns);
+            cout << "abcomp(" << k << ",n): " << S[k - 1].size() << " states" << endl;
+        }
+        log_duration(">>>", t0);
+
+        return 0;
+    });
+}
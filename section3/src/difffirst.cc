@@ -68,90 +68,88 @@ int main(int argc, char** argv) {
     string dt = argv[1];
     string ns = "msd_" + dt;
 
-    vector<map<vector<int>,int>> trans_raw1;
-    vector<map<vector<int>,int>> trans_raw2;
-    vector<int> out_raw1;
-    vector<int> out_raw2;
-    LabelMapper labelmap;
-
-    cout << "* Chargement de abfirsts" << dt << endl;
-    auto t0 = now();
-    dfa_from_walnut("abfirsts" + dt + ".txt", trans_raw1, out_raw1, labelmap);
-    cout << "labelmap size: " << labelmap.size() << endl;
-    log_duration(">>>", t0);
-
-    automaton_t s;
-    LabelMapper proj_map1;
-    LabelMapper proj_map2;
-
-    cout << "Comptage de s1" << endl;
-    t0 = now();
-    vector<int> vars = {1,2};
-    tie(s, proj_map1) = dfa_count(trans_raw1, out_raw1, labelmap, vars);
-    summary(*s);
-    cout << "proj_map size: " << proj_map1.size() << endl;
-    log_duration(">>>", t0);
-
-    cout << "Réduction de s1" << endl;
-    t0 = now();
-    auto s1 = reduce(s);
-    summary(*s1);
-    log_duration(">>>", t0);
-
-    cout << "* Chargement de abfirst" << dt << endl;
-    t0 = now();
-    dfa_from_walnut("abfirst" + dt + ".txt", trans_raw2, out_raw2, labelmap);
-    cout << "labelmap size: " << labelmap.size() << endl;
-    log_duration(">>>", t0);
-
-    cout << "Comptage de s2" << endl;
-    t0 = now();
-    tie(s, proj_map2) = dfa_count(trans_raw2, out_raw2, labelmap, vars);
-    summary(*s);
-    cout << "proj_map size: " << proj_map2.size() << endl;
-    log_duration(">>>", t0);
-
-    assert(proj_map1.to_tuple == proj_map2.to_tuple);
-
-    cout << "Réduction de s2" << endl;
-    t0 = now();
-    auto s2 = reduce(s);
-    opposite_here(s2);
-    summary(*s2);
-    log_duration(">>>", t0);
-
-
-    cout << "Somme s=s1+s2" << endl;
-    t0 = now();
-    auto s3 = sum(s1, s2);
-    summary(*s3);
-    log_duration(">>>", t0);
-
-
-    cout << "Réduction de s" << endl;
-    t0 = now();
-    auto red = reduce(s3);
-    summary(*red);
-    log_duration(">>>", t0);
-
-    cout << "Exploration t" << endl;
-    t0 = now();
-    auto t = explore_by_length(red, 1000000);
-    summary(*t);
-    log_duration(">>>", t0);
-
-    cout << "Complétion de t" << endl;
-    t0 = now();
-    complete_here(t);
-    summary(*t);
-    log_duration(">>>", t0);
-
-    cout << "Écriture de la sortie" << endl;
-    t0 = now();
-    ofstream fout("Diffabeq" + dt + ".txt");
-    to_walnut(t, proj_map1, fout, ns);
-    log_duration(">>>", t0);
-
-    return 0;
+    checkpoint ck("Diffabeq" + dt + ".partial.mpl");
+    return run_tool(ck, [&]() {
+        vector<map<vector<int>,int>> trans_raw1;
+        vector<map<vector<int>,int>> trans_raw2;
+        vector<int> out_raw1;
+        vector<int> out_raw2;
+        LabelMapper labelmap;
+
+        cout << "* Chargement de abfirsts" << dt << endl;
+        auto t0 = now();
+        dfa_from_walnut("abfirsts" + dt + ".txt", trans_raw1, out_raw1, labelmap);
+        cout << "labelmap size: " << labelmap.size() << endl;
+        log_duration(">>>", t0);
+
+        automaton_t s;
+        LabelMapper proj_map1;
+        LabelMapper proj_map2;
+
+        cout << "Comptage de s1" << endl;
+        t0 = now();
+        vector<int> vars = {1,2};
+        tie(s, proj_map1) = dfa_count(trans_raw1, out_raw1, labelmap, vars);
+        summary(*s);
+        cout << "proj_map size: " << proj_map1.size() << endl;
+        log_duration(">>>", t0);
+
+        cout << "Réduction de s1" << endl;
+        t0 = now();
+        check_dimension(vector<automaton_t>{s});
+        auto s1 = reduce(s);
+        summary(*s1);
+        ck.set(s1, proj_map1, {"k", "n"});
+        log_duration(">>>", t0);
+
+        cout << "* Chargement de abfirst" << dt << endl;
+        t0 = now();
+        dfa_from_walnut("abfirst" + dt + ".txt", trans_raw2, out_raw2, labelmap);
+        cout << "labelmap size: " << labelmap.size() << endl;
+        log_duration(">>>", t0);
+
+        cout << "Comptage de s2" << endl;
+        t0 = now();
+        tie(s, proj_map2) = dfa_count(trans_raw2, out_raw2, labelmap, vars);
+        summary(*s);
+        cout << "proj_map size: " << proj_map2.size() << endl;
+        log_duration(">>>", t0);
+
+        assert(proj_map1.to_tuple == proj_map2.to_tuple);
+
+        cout << "Réduction de s2" << endl;
+        t0 = now();
+        auto s2 = reduce(s);
+        summary(*s2);
+        log_duration(">>>", t0);
+
+
+        cout << "Réduction de s=s1+s2" << endl;
+        t0 = now();
+        auto red = reduce_difference(s1, opposite_view(s2));
+        summary(*red);
+        ck.set(red, proj_map1, {"k", "n"});
+        log_duration(">>>", t0);
+
+        cout << "Exploration t" << endl;
+        t0 = now();
+        auto t = explore_vectors(red);
+        summary(*t);
+        log_duration(">>>", t0);
+
+        cout << "Complétion de t" << endl;
+        t0 = now();
+        complete_here(t);
+        summary(*t);
+        log_duration(">>>", t0);
+
+        cout << "Écriture de la sortie" << endl;
+        t0 = now();
+        ofstream fout("Diffabeq" + dt + ".txt");
+        to_walnut(t, proj_map1, fout, ns);
+        log_duration(">>>", t0);
+
+        return 0;
+    });
 }
 
@@ -0,0 +1,152 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "fo.hh"
+
+
+using namespace std;
+using namespace awali::sttc;
+using namespace dfa;
+
+auto now() {
+    return chrono::steady_clock::now();
+}
+
+void log_duration(const std::string& label, std::chrono::steady_clock::time_point start) {
+    using namespace std;
+    auto end = chrono::steady_clock::now();
+    auto duration_ms = chrono::duration_cast<chrono::milliseconds>(end - start).count();
+
+    long long total_seconds = duration_ms / 1000;
+
+    cout << label << " ";
+
+    if (total_seconds < 60) {
+        // Format : 4.321s
+        cout << fixed << setprecision(3) << (duration_ms / 1000.0) << "s";
+    } else {
+        int hours = static_cast<int>(total_seconds / 3600);
+        int minutes = static_cast<int>((total_seconds % 3600) / 60);
+        int seconds = static_cast<int>(total_seconds % 60);
+
+        if (hours > 0)
+            cout << hours << ":" << setfill('0') << setw(2);
+        cout << minutes << ":" << setfill('0') << setw(2) << seconds;
+    }
+
+    cout << endl << endl;
+}
+
+void summary(const predicate& p) {
+    cout << p.a.size() << " states (";
+    for (size_t t = 0; t < p.vars.size(); ++t)
+        cout << (t > 0 ? "," : "") << p.vars[t];
+    cout << ")" << endl;
+}
+
+/*
+  The predicates of input/gen_abeq.txt and input/abcomp.txt, with the
+  first-order engine of fo.hh instead of Walnut:
+    same(i,j1,j2,k,n)  = Equifoo[i][j1][j2][k][n] = 0
+    abeqex(j1,j2,k,n)  = Ai same(i,j1,j2,k,n)
+    abeq(i,j,k,n)      = (n<k & feq(i,j,n))
+                       | (n>=k & feq(i,j,k-1) & abeqex(i,j,k,n-k))
+    abfirst(i,k,n)     = k>0 & ~Ej j<i & abeq(i,j,k,n)
+    abfirsts(i,k,n)    = abfirst(i,k+1,n)
+  where k-1 and n-k are existential variables t and m with t+1 = k and
+  m+k = n, as in Walnut.
+*/
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        cerr << "Usage: " << argv[0] << " ns\n"
+             << "  where ns is a numeration system and Equi[ns].txt, feq_[ns].txt,\n"
+             << "  msd_[ns].txt and msd_[ns]_addition.txt are the input\n"
+             << "  Output: abeq[ns].txt, abfirst[ns].txt and abfirsts[ns].txt\n";
+        return 1;
+    }
+
+    string dt = argv[1];
+    string ns = "msd_" + dt;
+
+    return run_tool([&]() {
+        vector<map<vector<int>,int>> equi, feq, add, valid;
+        vector<int> equi_out, feq_out, add_out, valid_out;
+        LabelMapper equimap, feqmap, addmap, validmap;
+
+        cout << "* Chargement de Equi" << dt << ", feq_" << dt << ", "
+             << ns << "_addition et " << ns << endl;
+        auto t0 = now();
+        dfa_from_walnut("Equi" + dt + ".txt", equi, equi_out, equimap);
+        dfa_from_walnut("feq_" + dt + ".txt", feq, feq_out, feqmap);
+        dfa_from_walnut(ns + "_addition.txt", add, add_out, addmap);
+        dfa_from_walnut(ns + ".txt", valid, valid_out, validmap);
+        int base = 0;
+        for (const auto* m : {&equimap, &feqmap, &addmap, &validmap})
+            for (int d : digits_of(*m))
+                base = max(base, d + 1);
+        dfa_table E(equi, equi_out, base), F(feq, feq_out, base),
+            A(add, add_out, base), V(valid, valid_out, base);
+        if (E.arity != 5 || F.arity != 3 || A.arity != 3 || V.arity != 1)
+            throw runtime_error("unexpected number of tracks");
+        numeration sys(V, A);
+        log_duration(">>>", t0);
+
+        cout << "same" << endl;
+        t0 = now();
+        for (auto& o : E.out)
+            o = o == 0 ? 1 : 0;
+        auto same = sys.atom(E, {"i", "j1", "j2", "k", "n"});
+        summary(same);
+        log_duration(">>>", t0);
+
+        cout << "abeqex" << endl;
+        t0 = now();
+        auto abeqex = sys.forall(same, "i");
+        summary(abeqex);
+        log_duration(">>>", t0);
+
+        cout << "abeq" << endl;
+        t0 = now();
+        auto short_factors = sys.conj(sys.less("n", "k"), sys.atom(F, {"i", "j", "n"}));
+        auto prefix = sys.exists(sys.conj(sys.plus("t", 1, "k"), sys.atom(F, {"i", "j", "t"})), "t");
+        auto rest = sys.exists(sys.conj(sys.sum("m", "k", "n"),
+                                        sys.rename(abeqex, {{"j1", "i"}, {"j2", "j"}, {"n", "m"}})),
+                               "m");
+        auto long_factors = sys.conj(sys.neg(sys.less("n", "k")), sys.conj(prefix, rest));
+        auto abeq = sys.disj(short_factors, long_factors);
+        summary(abeq);
+        log_duration(">>>", t0);
+
+        cout << "abfirst" << endl;
+        t0 = now();
+        auto earlier = sys.exists(sys.conj(sys.less("j", "i"), abeq), "j");
+        auto abfirst = sys.conj(sys.nonzero("k"), sys.neg(earlier));
+        summary(abfirst);
+        log_duration(">>>", t0);
+
+        cout << "abfirsts" << endl;
+        t0 = now();
+        auto abfirsts = sys.exists(sys.conj(sys.plus("k", 1, "k1"),
+                                            sys.rename(abfirst, {{"k", "k1"}})),
+                                   "k1");
+        summary(abfirsts);
+        log_duration(">>>", t0);
+
+        cout << "Écriture de la sortie" << endl;
+        t0 = now();
+        for (const auto& [name, p] : {make_pair(string("abeq"), &abeq), make_pair(string("abfirst"), &abfirst),
+                                      make_pair(string("abfirsts"), &abfirsts)}) {
+            ofstream fout(name + dt + ".txt");
+            if (!fout)
+                throw runtime_error("Cannot open file: " + name + dt + ".txt");
+            sys.write(*p, fout, ns);
+        }
+        log_duration(">>>", t0);
+
+        return 0;
+    });
+}
@@ -56,42 +56,47 @@ int main(int argc, char** argv) {
     if (argc != 3) {
         cerr << "Usage: " << argv[0] << " first.txt output.txt\n"
              << "  where first.txt is is the input computing abeqfirst(i,k,n)\n"
-             << "  and output.txt is the output file for the matrix representation\n";
+             << "  and output.txt is the output file for the matrix representation\n"
+             << "  (in Walnut's format if its name ends with .mpl)\n";
         return 1;
     }
 
     string first = argv[1];
     string dest = argv[2];
 
-    vector<map<vector<int>,int>> trans_raw;
-    vector<int> out_raw;
-    LabelMapper labelmap;
-
-    cout << "* Chargement de " << first << endl;
-    auto t0 = now();
-    dfa_from_walnut(first, trans_raw, out_raw, labelmap);
-    cout << "labelmap size: " << labelmap.size() << endl;
-    log_duration(">>>", t0);
-
-    automaton_t s;
-    LabelMapper proj_map;
-
-    cout << "Comptage de s" << endl;
-    t0 = now();
-    vector<int> vars = {1,2};
-    tie(s, proj_map) = dfa_count(trans_raw, out_raw, labelmap, vars);
-    summary(*s);
-    cout << "proj_map size: " << proj_map.size() << endl;
-    log_duration(">>>", t0);
-
-    cout << "Réduction de s1" << endl;
-    t0 = now();
-    auto s1 = reduce(s);
-    summary(*s1);
-    log_duration(">>>", t0);
-
-    ofstream fout(dest);
-    show_matrix(s1, proj_map, fout, true);
-    return 0;
+    checkpoint ck(dest + ".partial.mpl");
+    return run_tool(ck, [&]() {
+        vector<map<vector<int>,int>> trans_raw;
+        vector<int> out_raw;
+        LabelMapper labelmap;
+
+        cout << "* Chargement de " << first << endl;
+        auto t0 = now();
+        dfa_from_walnut(first, trans_raw, out_raw, labelmap);
+        cout << "labelmap size: " << labelmap.size() << endl;
+        log_duration(">>>", t0);
+
+        automaton_t s;
+        LabelMapper proj_map;
+
+        cout << "Comptage de s" << endl;
+        t0 = now();
+        vector<int> vars = {1,2};
+        tie(s, proj_map) = dfa_count(trans_raw, out_raw, labelmap, vars);
+        summary(*s);
+        cout << "proj_map size: " << proj_map.size() << endl;
+        log_duration(">>>", t0);
+
+        cout << "Réduction de s1" << endl;
+        t0 = now();
+        check_dimension(vector<automaton_t>{s});
+        auto s1 = reduce(s);
+        summary(*s1);
+        ck.set(s1, proj_map, {"k", "n"});
+        log_duration(">>>", t0);
+
+        write_matrices(s1, proj_map, dest, {"k", "n"}, true);
+        return 0;
+    });
 }
 
@@ -0,0 +1,382 @@
+#ifndef ABCOMP_FO_HH
+#define ABCOMP_FO_HH
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dfao.hh"
+
+namespace dfa {
+
+/*
+  First-order predicates of an msd numeration system, as Walnut's
+  ?msd_foo: a predicate is a complete DFA with one track per free
+  variable, in alphabetical order (the order of the arguments of
+  Walnut's def), accepting in the states of positive output.  The
+  variables range over the valid representations, the tracks are
+  synchronized and padded with leading zeros.
+  - the atoms are Walnut automata (feq_foo, the addition, a DFAO
+    compared to a value) whose tracks are given variables, <, x > 0
+    and x = constant, restricted to the valid tuples;
+  - conj, disj: products, after the tracks are aligned on the union of
+    the variables;
+  - neg: complement within the valid tuples;
+  - exists: projection of a track, then the subset construction with
+    hash-consed subsets, the initial subset being closed under the
+    letters that are zero on the other tracks (the witness may be
+    longer); the successors of the subsets of a level are computed in
+    parallel;
+  - forall: ~E~.
+  Every result is minimized (dfao.hh).
+*/
+
+struct predicate {
+    std::vector<std::string> vars;
+    dfa_table a;
+};
+
+/// The DFA of the tracks of a moved: track t of a is track pos[t] of
+/// the result, of the given arity (tracks of a sent to the same track
+/// read the same digits, those not reached by pos are free).
+inline dfa_table lift(const dfa_table& a, const std::vector<int>& pos, int arity) {
+    dfa_table res(arity, a.base);
+    std::vector<int> code(res.letters);
+    for (int c = 0; c < res.letters; ++c) {
+        std::vector<int> d(a.arity);
+        for (int t = 0; t < a.arity; ++t)
+            d[t] = res.digit(c, pos[t]);
+        code[c] = a.code(d);
+    }
+    res.out = a.out;
+    res.next.resize(a.size() * res.letters);
+    #pragma omp parallel for schedule(static)
+    for (size_t q = 0; q < a.size(); ++q)
+        for (int c = 0; c < res.letters; ++c)
+            res.next[q * res.letters + c] = a(q, code[c]);
+    return res;
+}
+
+/// a with a non accepting sink for the missing transitions.
+inline dfa_table complete(const dfa_table& a) {
+    dfa_table res = a;
+    if (res.size() == 0) {
+        res.add_state(0);
+        std::fill(res.next.begin(), res.next.end(), 0);
+        return res;
+    }
+    if (std::find(res.next.begin(), res.next.end(), -1) == res.next.end())
+        return res;
+    int sink = res.add_state(0);
+    for (auto& p : res.next)
+        if (p < 0)
+            p = sink;
+    return res;
+}
+
+struct subset_hash {
+    size_t operator()(const std::vector<int>& v) const {
+        size_t h = v.size();
+        for (int x : v)
+            h ^= std::hash<int> {}(x) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        return h;
+    }
+};
+
+class numeration {
+public:
+    /// valid: the DFA of msd_foo; addition: the DFA of x+y=z.
+    numeration(const dfa_table& valid, const dfa_table& addition,
+               awali::sttc::exec_context& ctx = awali::sttc::exec_context::global())
+        : valid_(valid), complete_valid_(complete(valid)), addition_(addition), ctx_(&ctx)
+    {}
+
+    int base() const {
+        return valid_.base;
+    }
+
+    /// All the tuples of valid representations of vars.
+    predicate valid(std::vector<std::string> vars) const {
+        std::sort(vars.begin(), vars.end());
+        vars.erase(std::unique(vars.begin(), vars.end()), vars.end());
+        // true, on no track
+        dfa_table res(0, base());
+        res.add_state(1);
+        res.next[0] = 0;
+        for (size_t t = 0; t < vars.size(); ++t)
+            res = product(lift(res, identity(t), t + 1),
+                          lift(complete_valid_, {int(t)}, t + 1), both, *ctx_);
+        return {vars, res};
+    }
+
+    /// The DFA a whose track t is the variable vars[t].
+    predicate atom(const dfa_table& a, const std::vector<std::string>& vars) const {
+        predicate p;
+        p.vars = vars;
+        std::sort(p.vars.begin(), p.vars.end());
+        p.vars.erase(std::unique(p.vars.begin(), p.vars.end()), p.vars.end());
+        std::vector<int> pos;
+        for (const auto& v : vars)
+            pos.push_back(index(p.vars, v));
+        p.a = lift(complete(a), pos, p.vars.size());
+        return conj(p, valid(p.vars));
+    }
+
+    /// x < y (the lexicographic order of the representations).
+    predicate less(const std::string& x, const std::string& y) const {
+        // 0: equal so far, 1: x < y, 2: x > y
+        dfa_table a(2, base());
+        for (int o : {0, 1, 0})
+            a.add_state(o);
+        for (int c = 0; c < a.letters; ++c) {
+            int dx = a.digit(c, 0), dy = a.digit(c, 1);
+            a.next[c] = dx < dy ? 1 : (dx > dy ? 2 : 0);
+            a.next[a.letters + c] = 1;
+            a.next[2 * a.letters + c] = 2;
+        }
+        return atom(a, {x, y});
+    }
+
+    /// x > 0.
+    predicate nonzero(const std::string& x) const {
+        dfa_table a(1, base());
+        a.add_state(0);
+        a.add_state(1);
+        for (int d = 0; d < base(); ++d) {
+            a.next[d] = d == 0 ? 0 : 1;
+            a.next[a.letters + d] = 1;
+        }
+        return atom(a, {x});
+    }
+
+    /// x = n.
+    predicate constant(const std::string& x, size_t n) const {
+        auto rep = representations(valid_, n + 1)[n];
+        // state p: p digits of rep read after the leading zeros
+        dfa_table a(1, base());
+        for (size_t p = 0; p <= rep.size(); ++p)
+            a.add_state(p == rep.size() ? 1 : 0);
+        a.next[0] = 0;
+        for (size_t p = 0; p < rep.size(); ++p)
+            a.next[p * a.letters + rep[p]] = p + 1;
+        return atom(a, {x});
+    }
+
+    /// x + y = z.
+    predicate sum(const std::string& x, const std::string& y, const std::string& z) const {
+        return atom(addition_, {x, y, z});
+    }
+
+    /// z = x + n.
+    predicate plus(const std::string& x, size_t n, const std::string& z) const {
+        std::string y = "#" + std::to_string(n);
+        return exists(conj(constant(y, n), sum(x, y, z)), y);
+    }
+
+    predicate conj(const predicate& p, const predicate& q) const {
+        return combine(p, q, both);
+    }
+
+    predicate disj(const predicate& p, const predicate& q) const {
+        return combine(p, q, [](int x, int y) { return x > 0 || y > 0 ? 1 : 0; });
+    }
+
+    predicate neg(const predicate& p) const {
+        predicate r = p;
+        for (auto& o : r.a.out)
+            o = o > 0 ? 0 : 1;
+        return conj(r, valid(p.vars));
+    }
+
+    predicate exists(const predicate& p, const std::string& x) const {
+        auto it = std::find(p.vars.begin(), p.vars.end(), x);
+        if (it == p.vars.end())
+            return p;
+        predicate q = conj(p, valid({x}));
+        int tx = it - p.vars.begin();
+        predicate r;
+        r.vars = p.vars;
+        r.vars.erase(r.vars.begin() + tx);
+        r.a = dfa_table(r.vars.size(), base());
+        const dfa_table& a = q.a;
+        // code in a of the letter c of r with d on the track of x
+        std::vector<int> code(size_t(r.a.letters) * base());
+        for (int c = 0; c < r.a.letters; ++c)
+            for (int d = 0; d < base(); ++d) {
+                std::vector<int> digits;
+                for (int t = 0; t < r.a.arity; ++t)
+                    digits.push_back(r.a.digit(c, t));
+                digits.insert(digits.begin() + tx, d);
+                code[size_t(c) * base() + d] = a.code(digits);
+            }
+        using subset_t = std::vector<int>;
+        auto successor = [&](const subset_t& s, int c) {
+            subset_t r;
+            for (int q : s)
+                for (int d = 0; d < base(); ++d) {
+                    int p = a(q, code[size_t(c) * base() + d]);
+                    if (p >= 0)
+                        r.push_back(p);
+                }
+            std::sort(r.begin(), r.end());
+            r.erase(std::unique(r.begin(), r.end()), r.end());
+            return r;
+        };
+        // the initial subset, closed under the zero letter of r
+        subset_t init{0};
+        while (true) {
+            subset_t s = successor(init, 0);
+            s.insert(s.end(), init.begin(), init.end());
+            std::sort(s.begin(), s.end());
+            s.erase(std::unique(s.begin(), s.end()), s.end());
+            if (s == init)
+                break;
+            init.swap(s);
+        }
+        std::unordered_map<subset_t, int, subset_hash> ids;
+        std::vector<const subset_t*> subsets;
+        auto get = [&](subset_t&& s) {
+            auto it = ids.find(s);
+            if (it != ids.end())
+                return it->second;
+            bool accept = false;
+            for (int q : s)
+                accept = accept || a.out[q] > 0;
+            int i = r.a.add_state(accept ? 1 : 0);
+            it = ids.emplace(std::move(s), i).first;
+            subsets.push_back(&it->first);
+            return i;
+        };
+        get(std::move(init));
+        size_t begin = 0;
+        while (begin < subsets.size()) {
+            size_t end = subsets.size();
+            std::vector<std::vector<subset_t>> succ(end - begin);
+            #pragma omp parallel for schedule(dynamic, 16)
+            for (size_t i = begin; i < end; ++i)
+                if (!ctx_->poll())
+                    for (int c = 0; c < r.a.letters; ++c)
+                        succ[i - begin].push_back(successor(*subsets[i], c));
+            ctx_->check();
+            for (size_t i = begin; i < end; ++i)
+                for (int c = 0; c < r.a.letters; ++c) {
+                    int j = get(std::move(succ[i - begin][c]));
+                    r.a.next[i * r.a.letters + c] = j;
+                }
+            ctx_->check_states(subsets.size());
+            begin = end;
+        }
+        r.a = minimize(r.a, *ctx_);
+        return r;
+    }
+
+    predicate forall(const predicate& p, const std::string& x) const {
+        return neg(exists(neg(p), x));
+    }
+
+    /// p with its variables renamed (two variables renamed to the same
+    /// one read the same digits).
+    predicate rename(const predicate& p, const std::map<std::string, std::string>& names) const {
+        std::vector<std::string> vars;
+        for (const auto& v : p.vars) {
+            auto it = names.find(v);
+            vars.push_back(it == names.end() ? v : it->second);
+        }
+        predicate r;
+        r.vars = vars;
+        std::sort(r.vars.begin(), r.vars.end());
+        r.vars.erase(std::unique(r.vars.begin(), r.vars.end()), r.vars.end());
+        std::vector<int> pos;
+        for (const auto& v : vars)
+            pos.push_back(index(r.vars, v));
+        r.a = minimize(lift(p.a, pos, r.vars.size()), *ctx_);
+        return r;
+    }
+
+    /// Writes p in Walnut's format, without the states from which no
+    /// state is accepting.
+    void write(const predicate& p, std::ostream& out, const std::string& ns) const {
+        const dfa_table& a = p.a;
+        // co-reachable states
+        std::vector<std::vector<int>> pred(a.size());
+        std::vector<int> todo;
+        std::vector<bool> live(a.size(), false);
+        for (size_t q = 0; q < a.size(); ++q) {
+            for (int c = 0; c < a.letters; ++c)
+                if (a(q, c) >= 0)
+                    pred[a(q, c)].push_back(q);
+            if (a.out[q] > 0) {
+                live[q] = true;
+                todo.push_back(q);
+            }
+        }
+        while (!todo.empty()) {
+            int q = todo.back();
+            todo.pop_back();
+            for (int p : pred[q])
+                if (!live[p]) {
+                    live[p] = true;
+                    todo.push_back(p);
+                }
+        }
+        dfa_table t(a.arity, a.base);
+        std::vector<int> index(a.size(), -1);
+        t.add_state(a.out[0] > 0 ? 1 : 0);
+        index[0] = 0;
+        for (size_t q = 1; q < a.size(); ++q)
+            if (live[q])
+                index[q] = t.add_state(a.out[q] > 0 ? 1 : 0);
+        for (size_t q = 0; q < a.size(); ++q)
+            if (index[q] >= 0)
+                for (int c = 0; c < a.letters; ++c) {
+                    int p = a(q, c);
+                    if (p >= 0 && live[p])
+                        t.next[size_t(index[q]) * t.letters + c] = index[p];
+                }
+        dfao_to_walnut(t, out, ns);
+    }
+
+private:
+    static int both(int x, int y) {
+        return x > 0 && y > 0 ? 1 : 0;
+    }
+
+    static int index(const std::vector<std::string>& vars, const std::string& v) {
+        return std::lower_bound(vars.begin(), vars.end(), v) - vars.begin();
+    }
+
+    static std::vector<int> identity(size_t n) {
+        std::vector<int> res(n);
+        for (size_t t = 0; t < n; ++t)
+            res[t] = t;
+        return res;
+    }
+
+    predicate combine(const predicate& p, const predicate& q,
+                      const std::function<int(int, int)>& op) const {
+        std::vector<std::string> vars;
+        std::set_union(p.vars.begin(), p.vars.end(), q.vars.begin(), q.vars.end(),
+                       std::back_inserter(vars));
+        std::vector<int> pp, pq;
+        for (const auto& v : p.vars)
+            pp.push_back(index(vars, v));
+        for (const auto& v : q.vars)
+            pq.push_back(index(vars, v));
+        return {vars, product(lift(p.a, pp, vars.size()), lift(q.a, pq, vars.size()),
+                              op, *ctx_)};
+    }
+
+    dfa_table valid_;
+    dfa_table complete_valid_;
+    dfa_table addition_;
+    awali::sttc::exec_context* ctx_;
+};
+
+}  // namespace dfa
+
+#endif
@@ -0,0 +1,20 @@
+// Instances of the templates of the headers that no tool uses, so
+// that `make check` compiles them (nothing is linked).
+
+#include <vector>
+
+#include "gmpq.hh"
+#include "reduce.hh"
+#include "walnut.hh"
+
+using namespace awali::sttc;
+
+using weightset_t = gmpq;
+using labelset_t = ctx::lal_int;
+using context_t = context<labelset_t, weightset_t>;
+using automaton_t = mutable_automaton<context_t>;
+
+// gview, broadcast_view, sum_view and reduce_view
+template automaton_t fromthere(const automaton_t&, label_t_of<automaton_t>,
+                               std::vector<int>, const automaton_t&, int);
+template void modify_transitions(automaton_t&, label_t_of<automaton_t>);
@@ -0,0 +1,368 @@
+#ifndef ABCOMP_KRYLOV_HH
+#define ABCOMP_KRYLOV_HH
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <awali/sttc/core/mutable_automaton.hh>
+#include "zp.hh"
+#include "context.hh"
+
+namespace awali {
+namespace sttc {
+
+/*
+  Dimensions of the reduction of a linear representation over Z/pZ
+  with sparse products only (a Krylov exploration), instead of the
+  echelon forms of length n of the reductioner.
+
+  The letter matrices are in compressed sparse rows, with their
+  transposes.  The vectors start.mu(w) are explored breadth first, and
+  a word is kept if the image of its vector by a linear map into a
+  small space of width s is independent of the images of the kept
+  words; the echelon form is only computed in this small space:
+  - for the ranks of the reachable (start = I) and co-reachable
+    (start = F, transposed matrices) spaces, the image is a sparse
+    random projection (each coordinate is sent with random weights to
+    3 random columns).  It is injective on the explored space with
+    high probability as long as its rank is at most 3s/4; otherwise,
+    s is doubled and the exploration restarted;
+  - for the dimension of the reduction, the rank of the Hankel matrix,
+    the image of v is (v.z_1, ..., v.z_s) where the z_j are random
+    combinations of the kept co-reachable vectors: the number of kept
+    words is the dimension of the reachable space modulo the
+    orthogonal of the co-reachable one.  The rank is exact as long as
+    it is smaller than s; otherwise s is doubled.
+  The memory is that of the matrices, of the vectors waiting to be
+  explored (sparse), of the echelon forms (width s) and of the z_j
+  (n.s, with s about the dimension of the reduction).  As with the
+  reductioner over Z/pZ, the dimensions can only be smaller than over
+  Q, and are equal with high probability.  This is a prediction only
+  (see check_dimension): the reduction itself is computed by the
+  reductioner over Q, and the kept words are not returned.
+*/
+namespace krylov {
+
+using value_t = zp::value_t;
+
+/// Sparse vectors: (index, non zero value), by increasing index.
+using sparse_t = std::vector<std::pair<unsigned, value_t>>;
+
+/// splitmix64
+inline uint64_t mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/// Pseudo random non zero element of Z/pZ.
+inline value_t random(uint64_t seed, uint64_t i)
+{
+    return 1 + mix(seed ^ mix(i)) % (zp::P - 1);
+}
+
+/// A matrix in compressed sparse rows.
+struct csr
+{
+    std::vector<unsigned> start;
+    std::vector<unsigned> col;
+    std::vector<value_t> val;
+};
+
+/// The matrix of the entries (row, column, value), summed.
+inline csr make_csr(unsigned n, std::vector<std::tuple<unsigned, unsigned, value_t>>& entries)
+{
+    std::sort(entries.begin(), entries.end());
+    csr m;
+    m.start.assign(n + 1, 0);
+    for (unsigned k = 0; k < entries.size(); ++k)
+    {
+        unsigned i, j;
+        value_t v;
+        std::tie(i, j, v) = entries[k];
+        if (k > 0 && std::get<0>(entries[k-1]) == i && std::get<1>(entries[k-1]) == j)
+        {
+            m.val.back() = zp::add(m.val.back(), v);
+            continue;
+        }
+        m.col.push_back(j);
+        m.val.push_back(v);
+        ++m.start[i + 1];
+    }
+    for (unsigned i = 0; i < n; ++i)
+        m.start[i + 1] += m.start[i];
+    return m;
+}
+
+/// Linear representation over Z/pZ.
+template<typename Label>
+struct representation
+{
+    unsigned dimension = 0;
+    sparse_t init, final;
+    std::vector<Label> letters;
+    // by letter, and transposed
+    std::vector<csr> mu, mu_t;
+};
+
+/// The representation of the sum of parts (their states side by side);
+/// throws std::domain_error if p divides a denominator.
+template<typename Aut>
+auto make_representation(const std::vector<Aut>& parts)
+{
+    using label_t = label_t_of<Aut>;
+    representation<label_t> res;
+    std::unordered_map<label_t, unsigned> letter;
+    std::vector<std::vector<std::tuple<unsigned, unsigned, value_t>>> entries;
+    std::vector<std::pair<unsigned, value_t>> init, final;
+    unsigned offset = 0;
+    for (auto& a : parts)
+    {
+        std::unordered_map<state_t, unsigned> index;
+        for (auto s : a->states())
+            index.emplace(s, offset + index.size());
+        for (auto t : a->initial_transitions())
+            init.emplace_back(index[a->dst_of(t)], zp::conv(a->weight_of(t)));
+        for (auto t : a->final_transitions())
+            final.emplace_back(index[a->src_of(t)], zp::conv(a->weight_of(t)));
+        for (auto t : a->transitions())
+        {
+            auto it = letter.emplace(a->label_of(t), res.letters.size()).first;
+            if (it->second == res.letters.size())
+            {
+                res.letters.push_back(a->label_of(t));
+                entries.emplace_back();
+            }
+            value_t w = zp::conv(a->weight_of(t));
+            if (w != 0)
+                entries[it->second].emplace_back(index[a->src_of(t)], index[a->dst_of(t)], w);
+        }
+        offset += a->num_states();
+    }
+    res.dimension = offset;
+    for (auto* v : {&init, &final})
+    {
+        std::sort(v->begin(), v->end());
+        for (auto& e : *v)
+            if (e.second != 0)
+                (v == &init ? res.init : res.final).push_back(e);
+    }
+    for (auto& e : entries)
+    {
+        res.mu.push_back(make_csr(offset, e));
+        for (auto& x : e)
+            std::swap(std::get<0>(x), std::get<1>(x));
+        res.mu_t.push_back(make_csr(offset, e));
+    }
+    return res;
+}
+
+/// res := v.m, with a scratch vector of the dimension (left zero).
+inline void product(const sparse_t& v, const csr& m,
+                    std::vector<value_t>& acc, sparse_t& res)
+{
+    std::vector<unsigned> touched;
+    for (auto& e : v)
+        for (unsigned k = m.start[e.first]; k < m.start[e.first + 1]; ++k)
+        {
+            unsigned j = m.col[k];
+            if (acc[j] == 0)
+                touched.push_back(j);
+            // a zero in the middle of the sum may push j twice
+            acc[j] = zp::add(acc[j], zp::mul(e.second, m.val[k]));
+        }
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+    res.clear();
+    for (unsigned j : touched)
+    {
+        if (acc[j] != 0)
+            res.emplace_back(j, acc[j]);
+        acc[j] = 0;
+    }
+}
+
+/// Echelon form of dense vectors of a fixed width: the pivot of each
+/// row is 1, and is zero in the following rows.
+class echelon
+{
+public:
+    explicit echelon(unsigned width)
+        : width_(width)
+    {}
+
+    /// Reduces x; if it is not zero, it is normalized and inserted.
+    bool insert(std::vector<value_t> x)
+    {
+        for (unsigned i = 0; i < rows_.size(); ++i)
+            zp::axpy(x.data(), rows_[i].data(), width_, x[pivots_[i]]);
+        unsigned j = 0;
+        while (j < width_ && x[j] == 0)
+            ++j;
+        if (j == width_)
+            return false;
+        zp::scale(x.data(), width_, zp::inverse(x[j]));
+        pivots_.push_back(j);
+        rows_.push_back(std::move(x));
+        return true;
+    }
+
+    unsigned rank() const
+    {
+        return rows_.size();
+    }
+
+private:
+    unsigned width_;
+    std::vector<unsigned> pivots_;
+    std::vector<std::vector<value_t>> rows_;
+};
+
+/// The sparse random projection of width s.
+struct sketch
+{
+    unsigned width;
+    uint64_t seed;
+
+    void operator()(const sparse_t& v, std::vector<value_t>& x) const
+    {
+        for (auto& e : v)
+            for (uint64_t t = 0; t < 3; ++t)
+            {
+                unsigned j = mix((seed + 2 * t) ^ mix(e.first)) % width;
+                x[j] = zp::add(x[j], zp::mul(e.second, random(seed + 2 * t + 1, e.first)));
+            }
+    }
+};
+
+/// The kept words: the parent (-1 for the empty word) and the letter.
+using tree_t = std::vector<std::pair<int, unsigned>>;
+
+/*
+  Breadth first exploration of the vectors start.mu(w); the words
+  whose image (of width s) is independent of the images of the kept
+  ones are kept, and keep is called on their vectors.  Returns false as
+  soon as more than limit words are kept.  The successors of a vector
+  are computed in parallel.
+*/
+template<typename Image, typename Keep>
+bool explore(const sparse_t& start, const std::vector<csr>& mu,
+             unsigned dimension, unsigned width, unsigned limit,
+             const Image& image, const Keep& keep, tree_t& words,
+             exec_context& ctx)
+{
+    echelon basis(width);
+    std::deque<std::pair<unsigned, sparse_t>> todo;
+    words.clear();
+    auto add = [&](int parent, unsigned a, sparse_t& v,
+                   std::vector<value_t>& x) {
+        if (v.empty() || !basis.insert(std::move(x)))
+            return true;
+        if (basis.rank() > limit)
+            return false;
+        words.emplace_back(parent, a);
+        keep(v);
+        todo.emplace_back(words.size() - 1, std::move(v));
+        return true;
+    };
+    sparse_t first(start);
+    std::vector<value_t> x(width);
+    image(first, x);
+    if (!add(-1, 0, first, x))
+        return false;
+    unsigned m = mu.size();
+    std::vector<sparse_t> succ(m);
+    std::vector<std::vector<value_t>> images(m);
+    while (!todo.empty())
+    {
+        ctx.check();
+        auto cur = std::move(todo.front());
+        todo.pop_front();
+        #pragma omp parallel for schedule(dynamic, 1) if (m > 1)
+        for (unsigned a = 0; a < m; ++a)
+        {
+            static thread_local std::vector<value_t> acc;
+            acc.resize(dimension);
+            product(cur.second, mu[a], acc, succ[a]);
+            images[a].assign(width, 0);
+            image(succ[a], images[a]);
+        }
+        for (unsigned a = 0; a < m; ++a)
+            if (!add(cur.first, a, succ[a], images[a]))
+                return false;
+    }
+    return true;
+}
+
+struct dimensions
+{
+    unsigned reachable = 0, coreachable = 0, minimal = 0;
+};
+
+template<typename Label>
+dimensions dimension(const representation<Label>& r,
+                     exec_context& ctx = exec_context::global())
+{
+    dimensions res;
+    unsigned n = r.dimension;
+    if (n == 0)
+        return res;
+    auto none = [](const sparse_t&) {};
+    tree_t words;
+    unsigned s = 64;
+    while (!explore(r.init, r.mu, n, s, 3 * s / 4, sketch{s, 0x100}, none, words, ctx))
+        s *= 2;
+    res.reachable = words.size();
+
+    s = 64;
+    unsigned sz = 16;
+    std::vector<value_t> z, beta;
+    tree_t min_words;
+    while (true)
+    {
+        // z[i.sz + j]: i-th entry of z_j, a random combination of the
+        // kept co-reachable vectors
+        z.assign(size_t(n) * sz, 0);
+        beta.resize(sz);
+        unsigned kept = 0;
+        auto combine = [&](const sparse_t& v) {
+            for (unsigned j = 0; j < sz; ++j)
+                beta[j] = random((uint64_t(1) << 32) + kept, j);
+            ++kept;
+            for (auto& e : v)
+                zp::axpy(&z[size_t(e.first) * sz], beta.data(), sz, zp::sub(0, e.second));
+        };
+        if (!explore(r.final, r.mu_t, n, s, 3 * s / 4, sketch{s, 0x200}, combine, words, ctx))
+        {
+            s *= 2;
+            continue;
+        }
+        res.coreachable = words.size();
+        auto pairing = [&](const sparse_t& v, std::vector<value_t>& x) {
+            for (auto& e : v)
+                zp::axpy(x.data(), &z[size_t(e.first) * sz], sz, zp::sub(0, e.second));
+        };
+        if (explore(r.init, r.mu, n, sz, sz - 1, pairing, none, min_words, ctx))
+            break;
+        sz *= 2;
+    }
+    res.minimal = min_words.size();
+    return res;
+}
+
+}
+
+}
+}
+
+#endif
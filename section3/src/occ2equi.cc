@@ -57,85 +57,124 @@ auto s1tos2 = [](std::vector<int>& v) {
 };
 
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        cerr << "Usage: " << argv[0] << " ns\n"
+    bool native = argc == 3 && string(argv[1]) == "-n";
+    if (argc != 2 && !native) {
+        cerr << "Usage: " << argv[0] << " [-n] ns\n"
              << "  where ns is a numeration system and occ_[ns].txt is the input\n"
+             << "  -n: build occ_[ns] from feq_[ns].txt, msd_[ns]_addition.txt and msd_[ns].txt\n"
              << "  Output: Equi[ns].txt\n";
         return 1;
     }
 
-    string dt = argv[1];
+    string dt = argv[argc - 1];
     string ns = "msd_" + dt;
 
-    vector<map<vector<int>,int>> trans_raw;
-    vector<int> out_raw;
-    LabelMapper labelmap;
-
-    cout << "* Chargement de occ_" << dt << endl;
-    auto t0 = now();
-    dfa_from_walnut("occ_" + dt + ".txt", trans_raw, out_raw, labelmap);
-    cout << "labelmap size: " << labelmap.size() << endl;
-    log_duration(">>>", t0);
-
-    automaton_t s;
-    LabelMapper proj_map;
-
-    cout << "Comptage de s" << endl;
-    t0 = now();
-    vector<int> vars = {0,1,2,3,4};
-    tie(s, proj_map) = dfa_count(trans_raw, out_raw, labelmap, vars);
-    summary(*s);
-    cout << "proj_map size: " << proj_map.size() << endl;
-    log_duration(">>>", t0);
-
-    cout << "Réduction de s1" << endl;
-    t0 = now();
-    auto s1 = reduce(s);
-    summary(*s1);
-    log_duration(">>>", t0);
-
-    auto s1tos2 = [](const vector<int>& t) {
-        return vector<int> {t[0], t[2], t[1], t[3], t[4]};
-    };
-
-    cout << "Remap de s1 en s2" << endl;
-    t0 = now();
-    auto s2 = remap_labels(s1, proj_map, s1tos2);
-    opposite_here(s2);
-    summary(*s2);
-    log_duration(">>>", t0);
-
-    cout << "Somme s=s1+s2" << endl;
-    t0 = now();
-    auto s3 = sum(s1, s2);
-    summary(*s3);
-    log_duration(">>>", t0);
-
-
-    cout << "Réduction de s" << endl;
-    t0 = now();
-    auto red = reduce(s3);
-    summary(*red);
-    log_duration(">>>", t0);
-
-    cout << "Exploration t" << endl;
-    t0 = now();
-    auto t = explore_by_length(red, 1000000);
-    summary(*t);
-    log_duration(">>>", t0);
-
-    cout << "Complétion de t" << endl;
-    t0 = now();
-    complete_here(t);
-    summary(*t);
-    log_duration(">>>", t0);
-
-    cout << "Écriture de la sortie" << endl;
-    t0 = now();
-    ofstream fout("Equi" + dt + ".txt");
-    to_walnut(t, proj_map, fout, ns);
-    log_duration(">>>", t0);
-
-    return 0;
+    checkpoint ck("Equi" + dt + ".partial.mpl");
+    return run_tool(ck, [&]() {
+        automaton_t s;
+        LabelMapper proj_map;
+        auto t0 = now();
+
+        if (native) {
+            vector<map<vector<int>,int>> feq, add, valid;
+            vector<int> feq_out, add_out, valid_out;
+            LabelMapper feqmap, addmap, validmap;
+
+            cout << "* Chargement de feq_" << dt << ", " << ns << "_addition et " << ns << endl;
+            t0 = now();
+            dfa_from_walnut("feq_" + dt + ".txt", feq, feq_out, feqmap);
+            dfa_from_walnut(ns + "_addition.txt", add, add_out, addmap);
+            dfa_from_walnut(ns + ".txt", valid, valid_out, validmap);
+            auto digits = digits_of(validmap);
+            log_duration(">>>", t0);
+
+            automaton_t c;
+            LabelMapper cmap;
+
+            cout << "Comptage de s sans j2" << endl;
+            t0 = now();
+            tie(c, cmap) = occ_count(feq, feq_out, add, add_out, digits);
+            summary(*c);
+            log_duration(">>>", t0);
+
+            cout << "Réduction de s sans j2" << endl;
+            t0 = now();
+            c = reduce(c);
+            summary(*c);
+            ck.set(c, cmap, {"i", "j1", "k", "n"});
+            log_duration(">>>", t0);
+
+            cout << "Insertion de j2" << endl;
+            t0 = now();
+            all_tuples(proj_map, digits, 5);
+            s = insert_track(c, cmap, proj_map, 2, valid, valid_out);
+            summary(*s);
+            cout << "proj_map size: " << proj_map.size() << endl;
+            log_duration(">>>", t0);
+        } else {
+            vector<map<vector<int>,int>> trans_raw;
+            vector<int> out_raw;
+            LabelMapper labelmap;
+
+            cout << "* Chargement de occ_" << dt << endl;
+            t0 = now();
+            dfa_from_walnut("occ_" + dt + ".txt", trans_raw, out_raw, labelmap);
+            cout << "labelmap size: " << labelmap.size() << endl;
+            log_duration(">>>", t0);
+
+            cout << "Comptage de s" << endl;
+            t0 = now();
+            vector<int> vars = {0,1,2,3,4};
+            tie(s, proj_map) = dfa_count(trans_raw, out_raw, labelmap, vars);
+            summary(*s);
+            cout << "proj_map size: " << proj_map.size() << endl;
+            log_duration(">>>", t0);
+        }
+
+        cout << "Réduction de s1" << endl;
+        t0 = now();
+        check_dimension(vector<automaton_t>{s});
+        auto s1 = reduce(s);
+        summary(*s1);
+        ck.set(s1, proj_map, {"i", "j1", "j2", "k", "n"});
+        log_duration(">>>", t0);
+
+        auto s1tos2 = [](const vector<int>& t) {
+            return vector<int> {t[0], t[2], t[1], t[3], t[4]};
+        };
+
+        cout << "Remap de s1 en s2" << endl;
+        t0 = now();
+        auto s2 = opposite_view(remap_view(s1, proj_map, s1tos2));
+        summary(*s2);
+        log_duration(">>>", t0);
+
+        cout << "Réduction de s=s1+s2" << endl;
+        t0 = now();
+        auto red = reduce_difference(s1, s2);
+        summary(*red);
+        ck.set(red, proj_map, {"i", "j1", "j2", "k", "n"});
+        log_duration(">>>", t0);
+
+        cout << "Exploration t" << endl;
+        t0 = now();
+        auto t = explore_vectors(red);
+        summary(*t);
+        log_duration(">>>", t0);
+
+        cout << "Complétion de t" << endl;
+        t0 = now();
+        complete_here(t);
+        summary(*t);
+        log_duration(">>>", t0);
+
+        cout << "Écriture de la sortie" << endl;
+        t0 = now();
+        ofstream fout("Equi" + dt + ".txt");
+        to_walnut(t, proj_map, fout, ns);
+        log_duration(">>>", t0);
+
+        return 0;
+    });
 }
 
@@ -54,9 +54,15 @@ void log_duration(const std::string& label, std::chrono::steady_clock::time_poin
     cout << endl << endl;
 }
 
+static bool is_mpl(const string& f) {
+    return f.size() >= 4 && f.compare(f.size() - 4, 4, ".mpl") == 0;
+}
+
 int main(int argc, char** argv) {
-    if (argc < 4) {
-        std::cerr << "Usage: " << argv[0] << " input.txt [int1 int2 ... intN] output.txt\n";
+    if (argc < 3 || (argc < 4 && !is_mpl(argv[1]))) {
+        std::cerr << "Usage: " << argv[0] << " input.txt [int1 int2 ... intN] output.txt\n"
+                  << "  input.mpl (a linear representation from Walnut's eval) is read without ints\n"
+                  << "  output.mpl is written in Walnut's format\n";
         return 1;
     }
 
@@ -73,39 +79,55 @@ int main(int argc, char** argv) {
             return 1;
         }
     }
-    
-    vector<map<vector<int>,int>> trans_raw;
-    vector<int> out_raw;
-    LabelMapper labelmap;
-
-    cout << "* Chargement de " << input << endl;
-    auto t0 = now();
-    dfa_from_walnut(input, trans_raw, out_raw, labelmap);
-    cout << "labelmap size: " << labelmap.size() << endl;
-    log_duration(">>>", t0);
-
-    automaton_t s;
-    LabelMapper proj_map;
-
-    cout << "Comptage de s" << endl;
-    t0 = now();
-    tie(s, proj_map) = dfa_count(trans_raw, out_raw, labelmap, vars);
-    summary(*s);
-    cout << "proj_map size: " << proj_map.size() << endl;
-    log_duration(">>>", t0);
+
+    checkpoint ck(output + ".partial.mpl");
+    return run_tool(ck, [&]() {
+        automaton_t s;
+        LabelMapper proj_map;
+        vector<string> names;
+        auto t0 = now();
+
+        if (is_mpl(input)) {
+            cout << "* Chargement de " << input << endl;
+            t0 = now();
+            tie(s, proj_map) = mpl_from_walnut(input, &names);
+            summary(*s);
+            log_duration(">>>", t0);
+        } else {
+            vector<map<vector<int>,int>> trans_raw;
+            vector<int> out_raw;
+            LabelMapper labelmap;
+
+            cout << "* Chargement de " << input << endl;
+            t0 = now();
+            dfa_from_walnut(input, trans_raw, out_raw, labelmap);
+            cout << "labelmap size: " << labelmap.size() << endl;
+            log_duration(">>>", t0);
+
+            cout << "Comptage de s" << endl;
+            t0 = now();
+            tie(s, proj_map) = dfa_count(trans_raw, out_raw, labelmap, vars);
+            summary(*s);
+            cout << "proj_map size: " << proj_map.size() << endl;
+            log_duration(">>>", t0);
+
+            for (int i : vars)
+                names.push_back("x" + to_string(i));
+        }
         
-    cout << "Réduction de s" << endl;
-    t0 = now();
-    auto s1 = reduce(s);
-    summary(*s1);
-    log_duration(">>>", t0);
-
-    cout << "Écriture des matrices" << endl;
-    t0 = now();
-    ofstream fout(output);
-    show_matrix(s1, proj_map, fout, true);
-    log_duration(">>>", t0);
-
-    return 0;
+        cout << "Réduction de s" << endl;
+        t0 = now();
+        check_dimension(vector<automaton_t>{s});
+        auto s1 = reduce(s);
+        summary(*s1);
+        ck.set(s1, proj_map, names);
+        log_duration(">>>", t0);
+
+        cout << "Écriture des matrices" << endl;
+        t0 = now();
+        write_matrices(s1, proj_map, output, names, !is_mpl(input));
+        log_duration(">>>", t0);
+
+        return 0;
+    });
 }
-
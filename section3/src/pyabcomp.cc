@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+
+#include "gmpq.hh"
+#include "reduce.hh"
+#include "walnut.hh"
+
+
+namespace py = pybind11;
+using namespace awali::sttc;
+using namespace dfa;
+
+using automaton_t = mutable_automaton<context_t>;
+using values_t = py::array_t<long long, py::array::c_style | py::array::forcecast>;
+
+/*
+  Python bindings for the evaluation of the automatic sequences of
+  the notebooks (instead of valid/enumrepr/s.value in pure Python):
+
+    import numpy as np, pyabcomp
+    ns = pyabcomp.Numeration("msd_tri.txt")
+    comp = pyabcomp.load_dfao("Comp_tri3.txt")
+    comp(ns, np.arange(1000))                  # int64 array
+    rep = pyabcomp.load_mpl("comp_tri3.mpl")
+    rep(ns, np.arange(1000))
+
+  The values are the rows of a numpy array (one column per track when
+  there are several), read in place.  The counts of words of the
+  numeration system are extended with the GIL held (extend_counts);
+  the representations and the evaluations are then computed without it,
+  in parallel.
+*/
+
+/// A file mapped in memory, read only.
+class mapped_file {
+public:
+    explicit mapped_file(const std::string& filename) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open file: " + filename);
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            size_ = st.st_size;
+            data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if (data_ == MAP_FAILED)
+            throw std::runtime_error("Cannot map file: " + filename);
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    ~mapped_file() {
+        if (data_ != MAP_FAILED && data_ != nullptr)
+            munmap(data_, size_);
+    }
+
+    const char* begin() const { return static_cast<const char*>(data_); }
+    const char* end() const { return begin() + size_; }
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+struct numeration {
+    representation rep;
+    std::string name;
+    /// Held (with the GIL) when the counts of words of rep are extended,
+    /// and shared while they are read without the GIL.
+    std::unique_ptr<std::shared_mutex> counts = std::make_unique<std::shared_mutex>();
+};
+
+/// The length of the longest representation in ns of the values: the
+/// counts of words are extended once to it, so that the rows can then
+/// be unranked (tuple_of) in parallel.
+size_t extend_counts(numeration& ns, const long long* values, size_t n) {
+    long long m = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (values[i] < 0)
+            throw py::value_error("negative value: " + std::to_string(values[i]));
+        m = std::max(m, values[i]);
+    }
+    std::unique_lock<std::shared_mutex> lock(*ns.counts);
+    return ns.rep.length(m);
+}
+
+/// The tuples of the rows of values, one column per track, as the
+/// representations in ns padded with leading zeros to the same length,
+/// in flat buffers.  It only reads the counts of ns, extended by
+/// extend_counts up to width: each thread has its own reader.
+class tuple_reader {
+public:
+    tuple_reader(const numeration& ns, size_t arity, size_t width)
+        : ns_(ns), arity_(arity), width_(width),
+          reps_(arity * width), lengths_(arity), word_(arity * width)
+    {}
+
+    /// The length of the tuple of the row (arity values).
+    size_t operator()(const long long* row) {
+        size_t l = 0;
+        for (size_t t = 0; t < arity_; ++t) {
+            lengths_[t] = ns_.rep.unrank(row[t], &reps_[t * width_]);
+            l = std::max(l, lengths_[t]);
+        }
+        std::fill(word_.begin(), word_.begin() + l * arity_, 0);
+        for (size_t t = 0; t < arity_; ++t)
+            for (size_t p = 0, n = lengths_[t]; p < n; ++p)
+                word_[(l - n + p) * arity_ + t] = reps_[t * width_ + p];
+        return l;
+    }
+
+    /// The digits of the letter p of the last tuple, one per track.
+    const int* letter(size_t p) const {
+        return &word_[p * arity_];
+    }
+
+private:
+    const numeration& ns_;
+    size_t arity_, width_;
+    std::vector<int> reps_;
+    std::vector<size_t> lengths_;
+    std::vector<int> word_;
+};
+
+/// The number of rows of values for arity tracks.
+size_t rows_of(const values_t& values, size_t arity) {
+    if (values.ndim() == 1 && arity == 1)
+        return values.shape(0);
+    if (values.ndim() == 2 && size_t(values.shape(1)) == arity)
+        return values.shape(0);
+    throw py::value_error("expected " + std::to_string(arity) + " column(s)");
+}
+
+py::array_t<long long> eval_dfao(const dfa_table& a, numeration& ns, const values_t& values,
+                                 long long missing) {
+    size_t rows = rows_of(values, a.arity);
+    py::array_t<long long> res(rows);
+    const long long* in = values.data();
+    long long* out = res.mutable_data();
+    size_t width = extend_counts(ns, in, rows * a.arity);
+    {
+        py::gil_scoped_release release;
+        std::shared_lock<std::shared_mutex> lock(*ns.counts);
+        #pragma omp parallel
+        {
+            tuple_reader tuple(ns, a.arity, width);
+            #pragma omp for schedule(static)
+            for (size_t r = 0; r < rows; ++r) {
+                int q = a.size() > 0 ? 0 : -1;
+                for (size_t p = 0, l = tuple(in + r * a.arity); p < l && q >= 0; ++p) {
+                    const int* d = tuple.letter(p);
+                    bool ok = true;
+                    for (int t = 0; t < a.arity; ++t)
+                        ok = ok && d[t] < a.base;
+                    q = ok ? a(q, a.code(d)) : -1;
+                }
+                out[r] = q < 0 ? missing : a.out[q];
+            }
+        }
+    }
+    return res;
+}
+
+struct linear_representation {
+    automaton_t A;
+    LabelMapper al;
+    std::vector<std::string> vars;
+};
+
+/// The values of the linear representation on the rows of values, as
+/// integers: prefix_absorb_all walks the representations as a trie.
+py::array_t<long long> eval_mpl(const linear_representation& s, numeration& ns,
+                                const values_t& values) {
+    size_t arity = s.al.size() > 0 ? s.al[0].size() : 1;
+    size_t rows = rows_of(values, arity);
+    py::array_t<long long> res(rows);
+    const long long* in = values.data();
+    long long* out = res.mutable_data();
+    size_t width = extend_counts(ns, in, rows * arity);
+    {
+        py::gil_scoped_release release;
+        std::vector<std::vector<int>> prefixes(rows);
+        {
+            std::shared_lock<std::shared_mutex> lock(*ns.counts);
+            #pragma omp parallel
+            {
+                tuple_reader tuple(ns, arity, width);
+                std::vector<int> d(arity);
+                #pragma omp for schedule(static)
+                for (size_t r = 0; r < rows; ++r) {
+                    size_t l = tuple(in + r * arity);
+                    prefixes[r].reserve(l);
+                    for (size_t p = 0; p < l; ++p) {
+                        d.assign(tuple.letter(p), tuple.letter(p) + arity);
+                        auto it = s.al.to_int.find(d);
+                        prefixes[r].push_back(it == s.al.to_int.end() ? -1 : it->second);
+                    }
+                }
+            }
+        }
+        auto vectors = prefix_absorb_all(s.A, prefixes);
+        std::vector<value_t> fin;
+        for (auto q : s.A->states())
+            fin.push_back(s.A->get_final_weight(q));
+        for (size_t r = 0; r < rows; ++r) {
+            value_t x(0);
+            for (size_t i = 0; i < fin.size(); ++i)
+                x += vectors[r][i] * fin[i];
+            x.canonicalize();
+            if (x.get_den() != 1 || !x.get_num().fits_slong_p())
+                throw py::value_error("not a machine integer: " + x.get_str());
+            out[r] = x.get_num().get_si();
+        }
+    }
+    return res;
+}
+
+PYBIND11_MODULE(pyabcomp, m) {
+    m.doc() = "Evaluation of Walnut DFAOs and linear representations (section3/src)";
+
+    py::class_<numeration>(m, "Numeration")
+        .def(py::init([](const std::string& filename) {
+                 mapped_file f(filename);
+                 return numeration{representation(dfao_from_walnut(f.begin(), f.end())), filename};
+             }),
+             py::arg("filename"), "The numeration system of a msd_*.txt file")
+        .def_property_readonly("base", [](const numeration& ns) { return ns.rep.base(); })
+        .def("repr", [](numeration& ns, unsigned long long x) {
+                 std::unique_lock<std::shared_mutex> lock(*ns.counts);
+                 return ns.rep(x);
+             },
+             py::arg("x"), "The msd representation of x, without leading zeros")
+        .def("__repr__", [](const numeration& ns) { return "<Numeration " + ns.name + ">"; });
+
+    py::class_<dfa_table>(m, "DFAO")
+        .def_readonly("arity", &dfa_table::arity)
+        .def_readonly("base", &dfa_table::base)
+        .def_property_readonly("size", &dfa_table::size)
+        .def("__call__", &eval_dfao, py::arg("ns"), py::arg("values"), py::arg("missing") = 0,
+             "The outputs on the values (one column per track), missing if the\n"
+             "path is not defined");
+
+    m.def("load_dfao", [](const std::string& filename, int base) {
+              mapped_file f(filename);
+              return dfao_from_walnut(f.begin(), f.end(), base);
+          },
+          py::arg("filename"), py::arg("base") = 0,
+          "Reads a DFAO (or a DFA) written by Walnut, mapped in memory");
+
+    py::class_<linear_representation>(m, "LinearRepresentation")
+        .def_property_readonly("dim", [](const linear_representation& s) {
+            return s.A->num_states();
+        })
+        .def_readonly("vars", &linear_representation::vars)
+        .def("__call__", &eval_mpl, py::arg("ns"), py::arg("values"),
+             "The (integer) values on the values (one column per track)");
+
+    m.def("load_mpl", [](const std::string& filename, bool reduced) {
+              linear_representation s;
+              std::tie(s.A, s.al) = mpl_from_walnut(filename, &s.vars);
+              if (reduced) {
+                  py::gil_scoped_release release;
+                  s.A = reduce(s.A);
+              }
+              return s;
+          },
+          py::arg("filename"), py::arg("reduce") = true,
+          "Reads a linear representation written by Walnut's eval (.mpl),\n"
+          "reduced by default");
+}
@@ -21,6 +21,7 @@
 #ifdef USE_OPENMP
 #include<omp.h>
 #endif
+#include <iostream>
 # include <gmpxx.h>
 # include <map>
 # include <unordered_map>
@@ -29,6 +30,13 @@
 #include <deque>
 #include <atomic>
 #include <mutex>
+#include <tuple>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
 
 #include <awali/sttc/algos/copy.hh>
 #include <awali/sttc/algos/transpose.hh>
@@ -37,12 +45,178 @@
 #include <awali/sttc/weightset/r.hh>
 #include <awali/sttc/weightset/z.hh>
 #include "gmpq.hh"
+#include "zp.hh"
+#include "krylov.hh"
+#include "context.hh"
 
 namespace awali {
 namespace sttc {
 
+/*
+  Choice of the pivot among the non zero entries of a new vector of the
+  basis (for gmpq), set by the environment variable ABCOMP_PIVOT:
+  - norm: the entry with the smallest absolute value (default);
+  - bitsize: the entry with the smallest numerator and denominator;
+  - colcount: the column with the fewest non zero entries in the
+    matrices of the letters (i.e. the coordinate that least often
+    appears in the products), then bitsize; these counts are those of
+    the input and are not updated during the elimination, so this is
+    not the Markowitz cost of the fill-in;
+  - first: the first non zero entry.
+*/
+enum class pivot_strategy { norm, bitsize, colcount, first };
+
+inline const char* to_string(pivot_strategy p)
+{
+    switch (p) {
+    case pivot_strategy::bitsize: return "bitsize";
+    case pivot_strategy::colcount: return "colcount";
+    case pivot_strategy::first: return "first";
+    default: return "norm";
+    }
+}
+
+inline pivot_strategy pivot_strategy_from_env()
+{
+    const char* s = std::getenv("ABCOMP_PIVOT");
+    if (s == nullptr || *s == 0)
+        return pivot_strategy::norm;
+    for (auto p : {pivot_strategy::norm, pivot_strategy::bitsize,
+                   pivot_strategy::colcount, pivot_strategy::first})
+        if (std::strcmp(s, to_string(p)) == 0)
+            return p;
+    throw std::invalid_argument(std::string("ABCOMP_PIVOT: unknown strategy ") + s);
+}
+
+/// Engine of the predicted dimension, set by the environment variable
+/// ABCOMP_DIM_ENGINE: krylov (sparse products only, see krylov.hh, the
+/// default) or echelon (the reductioner over Z/pZ).
+enum class dimension_engine { echelon, krylov };
+
+inline dimension_engine dimension_engine_from_env()
+{
+    const char* s = std::getenv("ABCOMP_DIM_ENGINE");
+    if (s == nullptr || *s == 0 || std::strcmp(s, "krylov") == 0)
+        return dimension_engine::krylov;
+    if (std::strcmp(s, "echelon") == 0)
+        return dimension_engine::echelon;
+    throw std::invalid_argument(std::string("ABCOMP_DIM_ENGINE: unknown engine ") + s);
+}
+
+/// Lumping pre-pass of reduce, set by the environment variable
+/// ABCOMP_LUMP (0, the default, or 1).
+inline bool lump_from_env()
+{
+    const char* s = std::getenv("ABCOMP_LUMP");
+    if (s == nullptr || *s == 0 || std::strcmp(s, "0") == 0)
+        return false;
+    if (std::strcmp(s, "1") == 0)
+        return true;
+    throw std::invalid_argument(std::string("ABCOMP_LUMP: not 0 or 1: ") + s);
+}
+
+/// Budget on the dimension of the reductions read from the variable
+/// name (0, no budget, if it is not set).
+inline unsigned dimension_budget(const char* name)
+{
+    const char* s = std::getenv(name);
+    if (s == nullptr || *s == 0)
+        return 0;
+    char* end;
+    unsigned long n = std::strtoul(s, &end, 10);
+    if (*end != 0)
+        throw std::invalid_argument(std::string(name) + ": not a number: " + s);
+    return n;
+}
+
+/// Prediction of the dimension before the main reduction of a tool
+/// (see check_dimension), set by the environment variable
+/// ABCOMP_PREDICT (0, the default, or 1); it is also made when a
+/// budget on the dimension is set.
+inline bool predict_from_env()
+{
+    const char* s = std::getenv("ABCOMP_PREDICT");
+    if (s != nullptr && std::strcmp(s, "1") == 0)
+        return true;
+    if (s != nullptr && *s != 0 && std::strcmp(s, "0") != 0)
+        throw std::invalid_argument(std::string("ABCOMP_PREDICT: not 0 or 1: ") + s);
+    return dimension_budget("ABCOMP_WARN_DIM") != 0 || dimension_budget("ABCOMP_MAX_DIM") != 0;
+}
+
 namespace internal
 {
+inline int num_threads()
+{
+#ifdef USE_OPENMP
+    return omp_get_num_threads();
+#else
+    return 1;
+#endif
+}
+
+/*
+  A vector of rationals with a common denominator: the i-th entry is
+  num[i]/den, with den > 0.  The vectors of the basis over Q share most
+  of their denominators; they are stored once per vector, and the
+  eliminations are computed on the integer numerators, without
+  canonicalizing each entry.
+*/
+struct scaled_vector
+{
+    scaled_vector()
+        : den(1)
+    {}
+
+    explicit scaled_vector(std::size_t n)
+        : den(1), num(n)
+    {}
+
+    explicit scaled_vector(const std::vector<mpq_class>& v)
+        : den(1), num(v.size())
+    {
+        for (auto& x : v)
+            if (x != 0)
+                mpz_lcm(den.get_mpz_t(), den.get_mpz_t(), x.get_den_mpz_t());
+        for (std::size_t i = 0; i < v.size(); ++i)
+            if (v[i] != 0)
+            {
+                mpz_divexact(num[i].get_mpz_t(), den.get_mpz_t(), v[i].get_den_mpz_t());
+                num[i] *= v[i].get_num();
+            }
+    }
+
+    mpq_class operator[](std::size_t i) const
+    {
+        mpq_class res(num[i], den);
+        res.canonicalize();
+        return res;
+    }
+
+    /// Divide the numerators and the denominator by their gcd, which is
+    /// usually found to be 1 after a few entries.
+    void canonicalize()
+    {
+        static thread_local mpz_class g;
+        g = den;
+        for (auto& x : num)
+        {
+            if (g == 1)
+                return;
+            if (x != 0)
+                mpz_gcd(g.get_mpz_t(), g.get_mpz_t(), x.get_mpz_t());
+        }
+        if (g == 1)
+            return;
+        mpz_divexact(den.get_mpz_t(), den.get_mpz_t(), g.get_mpz_t());
+        for (auto& x : num)
+            if (x != 0)
+                mpz_divexact(x.get_mpz_t(), x.get_mpz_t(), g.get_mpz_t());
+    }
+
+    mpz_class den;
+    std::vector<mpz_class> num;
+};
+
 /*
   The core algorithm computes a scaled basis from a list of
   vectors.  There is a permutation on entries in such a way that
@@ -64,6 +238,13 @@ namespace internal
   updated in such a way that the pivot becomes the first  non zero
   entry of v, which is inserted in the basis.
 
+  When the input is the sum of two automata given separately (see
+  reduce_difference), the basis starts with vectors that are unit
+  vectors on the first block (seed_first_block), and the columns of
+  the first block are preferred as pivots: a vector of the basis with
+  a pivot in the second block is zero on the first one, and the
+  entries that are zero are skipped.
+
   Once the basis is stabilized, a bottom-up reduction is applied
   to the scaled basis in order to make it more "diagonal".
   Finally, the new automaton is built w.r.t. the computed basis.
@@ -105,11 +286,21 @@ namespace internal
    normalisation_vector does not apply
    bottom_up_reduction does not apply
 
+   In Z/pZ : find_pivot is the generic one
+   reduce_vector and normalisation_vector work on the whole
+     vectors with the vectorized kernels of zp.hh
+   product_vector_matrix and scalar_product use the precomputed
+     quotients of zp::mul_fixed
+
 */
 
 template<typename Weightset>
 struct select
 {
+    /// Vectors of the basis.
+    template<typename W>
+    using vector = std::vector<W>;
+
     template<typename Reduc, typename Vector>
     static unsigned
     find_pivot(Reduc* that, const Vector& v,
@@ -119,11 +310,11 @@ struct select
     }
 
     template<typename Reduc, typename Vector>
-    static void
+    static auto
     reduce_vector(Reduc* that, Vector& vbasis,
                   Vector& current, unsigned b, unsigned* permutation)
     {
-        that->reduce_vector(vbasis, current, b, permutation);
+        return that->reduce_vector(vbasis, current, b, permutation);
     }
 
     template<typename Reduc, typename Vector>
@@ -141,25 +332,74 @@ struct select
         that->bottom_up_reduction(basis, permutation);
     }
 
-    template<typename Reduc, typename Basis, typename Vector>
+    template<typename Reduc, typename Basis, typename Vector, typename Coordinates>
     static void
     vector_in_new_basis(Reduc* that, Basis& basis,
-                        Vector& current, Vector& new_vector,
+                        Vector& current, Coordinates& new_vector,
                         unsigned* permutation)
     {
         that->vector_in_new_basis(basis, current, new_vector, permutation);
     }
+
+    template<typename Reduc, typename Vector, typename Matrix>
+    static void
+    product_vector_matrix(Reduc* that, const Vector& v, const Matrix& m,
+                          Vector& res)
+    {
+        that->product_vector_matrix(v, m, res);
+    }
+
+    template<typename Reduc, typename Vector>
+    static auto
+    scalar_product(Reduc* that, const Vector& v, const Vector& w)
+    {
+        return that->scalar_product(v, w);
+    }
 };
 
 template <>
 struct select<gmpq> : select<void>
 {
+    template<typename W>
+    using vector = scaled_vector;
+
     template<typename Reduc, typename Vector>
     static unsigned
     find_pivot(Reduc* that, const Vector& v,
                unsigned begin, unsigned* permutation)
     {
-        return that->find_pivot_by_norm(v, begin, permutation);
+        return that->find_pivot_by_strategy(v, begin, permutation);
+    }
+
+    template<typename Reduc, typename Vector>
+    static auto
+    reduce_vector(Reduc* that, Vector& vbasis,
+                  Vector& current, unsigned b, unsigned* permutation)
+    {
+        return that->gmpq_reduce_vector(vbasis, current, b, permutation);
+    }
+
+    template<typename Reduc, typename Vector>
+    static void
+    normalisation_vector(Reduc* that, Vector& v,
+                         unsigned pivot, unsigned* permutation)
+    {
+        that->gmpq_normalisation_vector(v, pivot, permutation);
+    }
+
+    template<typename Reduc, typename Vector, typename Matrix>
+    static void
+    product_vector_matrix(Reduc* that, const Vector& v, const Matrix& m,
+                          Vector& res)
+    {
+        that->gmpq_product_vector_matrix(v, m, res);
+    }
+
+    template<typename Reduc, typename Vector, typename Final>
+    static auto
+    scalar_product(Reduc* that, const Vector& v, const Final& w)
+    {
+        return that->gmpq_scalar_product(v, w);
     }
 };
 
@@ -224,7 +464,42 @@ struct select<z> : select<void>
     }
 };
 
-template <typename Aut, typename AutOutput>
+template <>
+struct select<zp> : select<void>
+{
+    template <typename Reduc, typename Vector>
+    static auto
+    reduce_vector(Reduc* that, Vector& vbasis,
+                  Vector& current, unsigned b, unsigned* permutation)
+    {
+        return that->zp_reduce_vector(vbasis, current, b, permutation);
+    }
+
+    template <typename Reduc, typename Vector>
+    static void
+    normalisation_vector(Reduc* that, Vector& v,
+                         unsigned pivot, unsigned* permutation)
+    {
+        that->zp_normalisation_vector(v, pivot, permutation);
+    }
+
+    template<typename Reduc, typename Vector, typename Matrix>
+    static void
+    product_vector_matrix(Reduc* that, const Vector& v, const Matrix& m,
+                          Vector& res)
+    {
+        that->zp_product_vector_matrix(v, m, res);
+    }
+
+    template<typename Reduc, typename Vector>
+    static auto
+    scalar_product(Reduc* that, const Vector& v, const Vector& w)
+    {
+        return that->zp_scalar_product(v, w);
+    }
+};
+
+template <typename Aut, typename AutOutput, typename Other = Aut>
 class reductioner
 {
     static_assert(context_t_of<Aut>::is_lal,
@@ -237,6 +512,8 @@ class reductioner
     using label_t = label_t_of<automaton_t>;
     using weight_t = typename context_t::weight_t;
     using vector_t = std::vector<weight_t>;
+    using basis_vector_t = typename select<weightset_t>::template vector<weight_t>;
+    using basis_t = std::vector<basis_vector_t>;
     using matrix_t = std::vector<std::map<std::size_t, weight_t> > ;
     using matrix_set_t = std::map<label_t, matrix_t>;
 
@@ -246,49 +523,165 @@ public:
         , res_(make_shared_ptr<output_automaton_t>(input_->context()))
     {}
 
-    /// Create the linear representation of the input
-    void linear_representation()
+    /// Reduction of the sum of two automata on the same alphabet,
+    /// without building it; the states of input come first.  other
+    /// may be a view (see views.hh).
+    reductioner(const automaton_t& input, const Other& other)
+        : input_(input)
+        , res_(make_shared_ptr<output_automaton_t>(input_->context()))
+        , other_(other)
+    {}
+
+    void set_pivot_strategy(pivot_strategy p)
+    {
+        strategy_ = p;
+    }
+
+    /// Progress and statistics on the standard output.
+    void set_verbose(bool v)
+    {
+        verbose_ = v;
+    }
+
+    /// Budgets and cancellation (the global context by default).
+    void set_context(exec_context& ctx)
+    {
+        ctx_ = &ctx;
+    }
+
+    template<typename A>
+    void add_letters(const A& a)
+    {
+        for (auto t : a->transitions())
+            if (letter_matrix_set.find(a->label_of(t)) == letter_matrix_set.end())
+                letter_matrix_set.emplace(a->label_of(t), matrix_t(dimension));
+    }
+
+    /// The states of a get the indices from i on.
+    template<typename A>
+    void add_part(const A& a, unsigned& i)
     {
         std::unordered_map<state_t, unsigned> state_to_index;
-        unsigned i = 0;
-        for (auto s: input_->states())
+        std::vector<state_t> states;
+        unsigned offset = i;
+        for (auto s: a->states())
+        {
             state_to_index[s] = i++;
-        dimension = i;
+            states.push_back(s);
+        }
+        // Computation of the initial vector.  The weights are
+        // added up: a view may have several transitions with the
+        // same ends and label.
+        for (auto t : a->initial_transitions())
+        {
+            auto& w = init[state_to_index[a->dst_of(t)]];
+            w = ws_.add(w, a->weight_of(t));
+        }
+        // Computation of the final vector.
+        for (auto t : a->final_transitions())
+        {
+            auto& w = final[state_to_index[a->src_of(t)]];
+            w = ws_.add(w, a->weight_of(t));
+        }
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (unsigned k = 0; k < states.size(); ++k)
+            if (!ctx_->poll())
+                for (auto t : a->out(states[k]))
+                {
+                    auto& row = letter_matrix_set.at(a->label_of(t))[offset + k];
+                    auto it = row.emplace(state_to_index.at(a->dst_of(t)), ws_.zero()).first;
+                    it->second = ws_.add(it->second, a->weight_of(t));
+                    if (ws_.is_zero(it->second))
+                        row.erase(it);
+                }
+    }
+
+    /// Create the linear representation of the input
+    void linear_representation()
+    {
+        dimension = input_->num_states();
+        block_ = dimension;
+        if (other_)
+            dimension += other_->num_states();
         if (dimension == 0)
             return;
-        init.resize(i);
-        final.resize(i);
-        // Computation of the initial vector.
-        for (auto t : input_->initial_transitions())
-            init[state_to_index[input_->dst_of(t)]] = input_->weight_of(t);
-        // Computation of the final vector.
-        for (auto t : input_->final_transitions())
-            final[state_to_index[input_->src_of(t)]] = input_->weight_of(t);
-        // For each letter, we define an adjency matrix.
-        for (auto t : input_->transitions())
+        init.resize(dimension, ws_.zero());
+        final.resize(dimension, ws_.zero());
+        // For each letter, we define an adjency matrix; the matrices
+        // are created first, then filled row by row in parallel.
+        add_letters(input_);
+        if (other_)
+            add_letters(other_);
+        unsigned i = 0;
+        add_part(input_, i);
+        if (other_)
+            add_part(other_, i);
+        ctx_->check();
+        if constexpr (std::is_same<weightset_t, gmpq>::value)
+            for (auto& mu : letter_matrix_set)
+                for (auto& row : mu.second)
+                    for (auto& e : row)
+                        mpz_lcm(matrix_den_.get_mpz_t(), matrix_den_.get_mpz_t(),
+                                e.second.get_den_mpz_t());
+        if (strategy_ == pivot_strategy::colcount)
         {
-            auto it = letter_matrix_set.find(input_->label_of(t));
-            if (it == letter_matrix_set.end())
-                it = letter_matrix_set.emplace(input_->label_of(t),
-                                               matrix_t(dimension)).first;
-            it->second[state_to_index[input_->src_of(t)]]
-            [state_to_index[input_->dst_of(t)]] = input_->weight_of(t);
+            col_count_.assign(dimension, 0);
+            for (auto& mu : letter_matrix_set)
+                for (auto& row : mu.second)
+                    for (auto& e : row)
+                        ++col_count_[e.first];
         }
     }
 
     //utility methods
 
+    /// res := res + a.b
+    template<typename W>
+    void add_product(W& res, const W& a, const W& b)
+    {
+        res = ws_.add(res, ws_.mul(a, b));
+    }
+
+    /// res := res - a.b
+    template<typename W>
+    void sub_product(W& res, const W& a, const W& b)
+    {
+        res = ws_.sub(res, ws_.mul(a, b));
+    }
+
+    /// res := res / k
+    template<typename W>
+    void div_here(W& res, const W& k)
+    {
+        res = ws_.rdiv(res, k);
+    }
+
+    /// Accessors of the entries, for both kinds of vectors.
+    bool is_zero_at(const vector_t& v, unsigned j) const
+    {
+        return ws_.is_zero(v[j]);
+    }
+
+    static bool is_zero_at(const scaled_vector& v, unsigned j)
+    {
+        return v.num[j] == 0;
+    }
+
     /// Computes the product of a row vector with a matrix
     void product_vector_matrix(const vector_t& v,
                                const matrix_t& m,
                                vector_t& res)
     {
         for (unsigned i = 0; i < dimension; i++)
+        {
+            if (ws_.is_zero(v[i]))
+                continue;
             for (auto it : m[i])
             {
                 unsigned j = it.first;
-                res[j] = ws_.add(res[j], ws_.mul(v[i], it.second));
+                add_product(res[j], v[i], it.second);
             }
+        }
     }
 
     /// Computes the scalar product of two vectors.
@@ -297,7 +690,8 @@ public:
     {
         weight_t res = ws_.zero();
         for (unsigned i = 0; i < dimension; ++i)
-            res = ws_.add(res, ws_.mul(v[i], w[i]));
+            if (!ws_.is_zero(v[i]) && !ws_.is_zero(w[i]))
+                add_product(res, v[i], w[i]);
         return res;
     }
 
@@ -337,31 +731,122 @@ public:
         return std::fabs(w.get_d());
     }
 
+    /// Size in bits of a rational number (the norm otherwise).
+    static double bitsize(const gmpq::value_t& w) {
+        return mpz_sizeinbase(w.get_num_mpz_t(), 2)
+               + mpz_sizeinbase(w.get_den_mpz_t(), 2);
+    }
+
+    template<typename W>
+    static double bitsize(const W& w) {
+        return norm(w);
+    }
+
+    /// Number of GMP limbs used by a weight (0 if not a gmpq).
+    static size_t limbs(const gmpq::value_t& w) {
+        return mpz_size(w.get_num_mpz_t()) + mpz_size(w.get_den_mpz_t());
+    }
+
+    template<typename W>
+    static size_t limbs(const W&) {
+        return 0;
+    }
+
+    static size_t limbs(const vector_t& v) {
+        size_t n = 0;
+        for (auto& x : v)
+            n += limbs(x);
+        return n;
+    }
+
+    static size_t limbs(const scaled_vector& v) {
+        size_t n = mpz_size(v.den.get_mpz_t());
+        for (auto& x : v.num)
+            n += mpz_size(x.get_mpz_t());
+        return n;
+    }
+
+    auto norm_at(const vector_t& v, unsigned j) const {
+        return norm(v[j]);
+    }
+
+    /// In a scaled vector, the numerators compare as the entries;
+    /// log2 of the absolute value, which does not overflow.
+    static double norm_at(const scaled_vector& v, unsigned j) {
+        long e;
+        double m = mpz_get_d_2exp(&e, v.num[j].get_mpz_t());
+        return e + std::log2(std::fabs(m));
+    }
+
+    double bitsize_at(const vector_t& v, unsigned j) const {
+        return bitsize(v[j]);
+    }
+
+    static double bitsize_at(const scaled_vector& v, unsigned j) {
+        return mpz_sizeinbase(v.num[j].get_mpz_t(), 2);
+    }
+
     // Works for both Q and R.
+    // Entries of the first block come first, whatever their norm.
+    template<typename V>
     unsigned
-    find_pivot_by_norm(const vector_t& v, unsigned begin,
+    find_pivot_by_norm(const V& v, unsigned begin,
                        unsigned* permutation)
     {
         unsigned i=begin;
-        for(; i < dimension && ws_.is_zero(v[permutation[i]]); ++i)
+        for(; i < dimension && is_zero_at(v, permutation[i]); ++i)
             ;
         if(i==dimension)
             return dimension;
         unsigned pivot=i;
-        auto min = norm(v[permutation[i++]]);
+        bool in_block = permutation[i] < block_;
+        auto min = norm_at(v, permutation[i++]);
         for (; i < dimension; ++i)
-            if (!ws_.is_zero(v[permutation[i]])
-                    && (pivot == dimension
-                        || norm(v[permutation[i]])<min))
+            if (!is_zero_at(v, permutation[i])
+                    && ((permutation[i] < block_ && !in_block)
+                        || ((permutation[i] < block_) == in_block
+                            && norm_at(v, permutation[i])<min)))
             {
                 pivot = i;
-                min = norm(v[permutation[i]]);
+                in_block = permutation[i] < block_;
+                min = norm_at(v, permutation[i]);
             }
 //      std::cerr << v[permutation[pivot]] << std::endl;
         return pivot;
     }
 
 
+    /// Pivot with respect to strategy_; the entries of the first
+    /// block still come first.
+    template<typename V>
+    unsigned
+    find_pivot_by_strategy(const V& v, unsigned begin,
+                           unsigned* permutation)
+    {
+        if (strategy_ == pivot_strategy::norm)
+            return find_pivot_by_norm(v, begin, permutation);
+        if (strategy_ == pivot_strategy::first)
+            return find_pivot(v, begin, permutation);
+        unsigned pivot = dimension;
+        std::tuple<bool, double, double> min;
+        for (unsigned i = begin; i < dimension; ++i)
+        {
+            unsigned j = permutation[i];
+            if (is_zero_at(v, j))
+                continue;
+            std::tuple<bool, double, double> key(
+                j >= block_,
+                strategy_ == pivot_strategy::colcount ? col_count_[j] : 0,
+                bitsize_at(v, j));
+            if (pivot == dimension || key < min)
+            {
+                pivot = i;
+                min = key;
+            }
+        }
+        return pivot;
+    }
+
     // End of Q/R specializations.
 
 
@@ -454,6 +939,164 @@ public:
     }
     // End of Z specializations.
 
+
+    // Specialization for Z/pZ.
+
+    /*
+      Since all the entries of vbasis that come before its pivot are
+      zero and vbasis[pivot] = 1, current := current - ratio.vbasis
+      can be computed on the whole vectors, without the permutation,
+      by a vectorized loop.
+    */
+    weight_t zp_reduce_vector(vector_t& vbasis, vector_t& current,
+                              unsigned b, unsigned* permutation)
+    {
+        weight_t ratio = current[permutation[b]];
+        zp::axpy(current.data(), vbasis.data(), dimension, ratio);
+        return ratio;
+    }
+
+    void zp_normalisation_vector(vector_t& v, unsigned pivot,
+                                 unsigned* permutation)
+    {
+        weight_t k = v[permutation[pivot]];
+        if (!ws_.is_one(k))
+            zp::scale(v.data(), dimension, zp::inverse(k));
+    }
+
+    void zp_product_vector_matrix(const vector_t& v,
+                                  const matrix_t& m,
+                                  vector_t& res)
+    {
+        for (unsigned i = 0; i < dimension; i++)
+        {
+            if (v[i] == 0)
+                continue;
+            uint32_t vp = zp::shoup(v[i]);
+            for (auto it : m[i])
+            {
+                unsigned j = it.first;
+                res[j] = zp::add(res[j], zp::mul_fixed(it.second, v[i], vp));
+            }
+        }
+    }
+
+    weight_t zp_scalar_product(const vector_t& v, const vector_t& w)
+    {
+        return zp::dot(v.data(), w.data(), dimension);
+    }
+    // End of Z/pZ specializations.
+
+
+    // Specialization for Q (gmpq), on scaled vectors.
+
+    /*
+      current := current - (c/d).vbasis, where c/d = current[pivot]
+      and vbasis[pivot] = 1, i.e. vbasis.num[pivot] = vbasis.den.  With
+      g = gcd(c, vbasis.den), the numerators of current become
+      (vbasis.den/g).current.num - (c/g).vbasis.num and its denominator
+      (vbasis.den/g).d: only integer operations, and the gcd of the
+      whole vector is only computed when its denominator grows.
+      The entries of current before the pivot of vbasis may be non
+      zero (bottom_up_reduction), they are scaled as well.
+    */
+    weight_t gmpq_reduce_vector(const scaled_vector& vbasis,
+                                scaled_vector& current, unsigned b,
+                                unsigned* permutation)
+    {
+        unsigned pivot = permutation[b];
+        if (current.num[pivot] == 0)
+            return ws_.zero();
+        weight_t ratio(current.num[pivot], current.den);
+        ratio.canonicalize();
+        static thread_local mpz_class g, a, c;
+        mpz_gcd(g.get_mpz_t(), current.num[pivot].get_mpz_t(), vbasis.den.get_mpz_t());
+        mpz_divexact(a.get_mpz_t(), vbasis.den.get_mpz_t(), g.get_mpz_t());
+        mpz_divexact(c.get_mpz_t(), current.num[pivot].get_mpz_t(), g.get_mpz_t());
+        current.num[pivot] = 0;
+        bool scaled = a != 1;
+        if (scaled)
+        {
+            for (auto& x : current.num)
+                if (x != 0)
+                    x *= a;
+            current.den *= a;
+        }
+        for (unsigned i = b+1; i < dimension; ++i)
+        {
+            unsigned j = permutation[i];
+            if (vbasis.num[j] != 0)
+                mpz_submul(current.num[j].get_mpz_t(), c.get_mpz_t(),
+                           vbasis.num[j].get_mpz_t());
+        }
+        if (scaled)
+            current.canonicalize();
+        return ratio;
+    }
+
+    /// The pivot becomes the common denominator, hence equal to 1: no
+    /// division of the entries.
+    void gmpq_normalisation_vector(scaled_vector& v, unsigned pivot,
+                                   unsigned* permutation)
+    {
+        const mpz_class& p = v.num[permutation[pivot]];
+        if (p < 0)
+            for (auto& x : v.num)
+                if (x != 0)
+                    mpz_neg(x.get_mpz_t(), x.get_mpz_t());
+        v.den = p;
+        v.canonicalize();
+    }
+
+    /// res := v.m, the entries of the matrices being scaled by their
+    /// common denominator matrix_den_ (usually 1).
+    void gmpq_product_vector_matrix(const scaled_vector& v,
+                                    const matrix_t& m,
+                                    scaled_vector& res)
+    {
+        static thread_local mpz_class tmp;
+        bool integral = matrix_den_ == 1;
+        for (unsigned i = 0; i < dimension; i++)
+        {
+            if (v.num[i] == 0)
+                continue;
+            for (auto& it : m[i])
+            {
+                unsigned j = it.first;
+                if (integral)
+                    mpz_addmul(res.num[j].get_mpz_t(), v.num[i].get_mpz_t(),
+                               it.second.get_num_mpz_t());
+                else
+                {
+                    mpz_divexact(tmp.get_mpz_t(), matrix_den_.get_mpz_t(),
+                                 it.second.get_den_mpz_t());
+                    tmp *= it.second.get_num();
+                    mpz_addmul(res.num[j].get_mpz_t(), v.num[i].get_mpz_t(),
+                               tmp.get_mpz_t());
+                }
+            }
+        }
+        res.den = v.den * matrix_den_;
+        res.canonicalize();
+    }
+
+    /// v.w, where w (the final vector) is not scaled.
+    weight_t gmpq_scalar_product(const scaled_vector& v, const vector_t& w)
+    {
+        weight_t res = ws_.zero();
+        static thread_local mpq_class tmp;
+        for (unsigned i = 0; i < dimension; ++i)
+            if (v.num[i] != 0 && !ws_.is_zero(w[i]))
+            {
+                mpz_mul(tmp.get_num_mpz_t(), v.num[i].get_mpz_t(), w[i].get_num_mpz_t());
+                tmp.get_den() = w[i].get_den();
+                tmp.canonicalize();
+                res += tmp;
+            }
+        return res / v.den;
+    }
+    // End of Q specializations.
+
     /* Generic subroutines.
         These methods are written for any (skew) field.
         Some are specialized for Q and R for stability issues.
@@ -462,13 +1105,20 @@ public:
 
     /// Return the first (w.r.t the column permutation) non zero
     /// element as pivot.
-    unsigned find_pivot(const vector_t& v, unsigned begin,
+    template<typename V>
+    unsigned find_pivot(const V& v, unsigned begin,
                         unsigned* permutation)
     {
+        unsigned first = dimension;
         for (unsigned i = begin; i < dimension; ++i)
-            if (!ws_.is_zero(v[permutation[i]]))
-                return i;
-        return dimension;
+            if (!is_zero_at(v, permutation[i]))
+            {
+                if (permutation[i] < block_)
+                    return i;
+                if (first == dimension)
+                    first = i;
+            }
+        return first;
     }
 
     /** Reduce a vector w.r.t. a vector of the basis.
@@ -490,9 +1140,9 @@ public:
         // This is safer than current[p] = current[p]-ratio*vbasis[p];
         current[pivot] = ws_.zero();
         for (unsigned i = b+1; i < dimension; ++i)
-            current[permutation[i]]
-                = ws_.sub(current[permutation[i]],
-                          ws_.mul(ratio, vbasis[permutation[i]]));
+            if (!ws_.is_zero(vbasis[permutation[i]]))
+                sub_product(current[permutation[i]], ratio,
+                            vbasis[permutation[i]]);
         return ratio;
     }
 
@@ -505,27 +1155,159 @@ public:
         {
             v[permutation[pivot]] = ws_.one();
             for (unsigned r = pivot + 1; r < dimension; ++r)
-                v[permutation[r]] = ws_.rdiv(v[permutation[r]], k);
+                if (!ws_.is_zero(v[permutation[r]]))
+                    div_here(v[permutation[r]], k);
         }
     }
 
     /// Apply reduction to vectors of the basis to maximize the
-    /// number of zeros.
-    void bottom_up_reduction(std::vector<vector_t>& basis,
+    /// number of zeros.  For a given b, the preceding vectors are
+    /// reduced in parallel.
+    void bottom_up_reduction(basis_t& basis,
                              unsigned* permutation)
     {
+        #pragma omp parallel
         for (unsigned b = basis.size()-1; 0 < b; --b)
+        {
+            #pragma omp for schedule(dynamic, 16)
             for (unsigned c = 0; c < b; ++c)
-                reduce_vector(basis[b], basis[c], b, permutation);
+                if (!ctx_->poll())
+                    select<weightset_t>::reduce_vector(this, basis[b], basis[c],
+                                                       b, permutation);
+        }
     }
 
     /// Compute the coordinate of a vector in the new basis.
-    void vector_in_new_basis(std::vector<vector_t>& basis,
-                             vector_t& current, vector_t& new_vector,
+    void vector_in_new_basis(basis_t& basis,
+                             basis_vector_t& current, vector_t& new_vector,
                              unsigned* permutation)
     {
         for (unsigned b = 0; b < basis.size(); ++b)
-            new_vector[b] = reduce_vector(basis[b], current, b, permutation);
+            new_vector[b] = select<weightset_t>::reduce_vector(this, basis[b],
+                            current, b, permutation);
+    }
+
+    /*
+      Seeds of the reduction of a sum (see reduce_difference).  The
+      first block is an automaton that is already reduced, so that its
+      vectors span the whole block: words whose vectors are independent
+      on the first block are found by a breadth-first search in this
+      block only, over Z/pZ (independent modulo p implies independent
+      over Q).  Their vectors over Q are then reduced to the form
+      (e_i, phi_i), a unit vector on the first block, and put at the
+      beginning of the basis.  A product of a seed by a letter is then
+      reduced by the few seeds given by the transitions of the state i,
+      which only changes its entries in the second block, and the
+      exploration only adds vectors of the second block.
+      Returns the number of seeds, 0 if p divides a denominator.
+    */
+    unsigned seed_first_block(basis_t& basis, unsigned* permutation,
+                              const std::vector<label_t>& letters)
+    {
+        using type_t = select<weightset_t>;
+        unsigned n = block_, m = letters.size();
+        using zp_row_t = std::vector<std::pair<unsigned, zp::value_t>>;
+        std::vector<std::vector<zp_row_t>> mu(m, std::vector<zp_row_t>(n));
+        std::vector<zp::value_t> first(n, 0);
+        try {
+            for (unsigned i = 0; i < n; ++i)
+                if (!ws_.is_zero(init[i]))
+                    first[i] = zp::conv(init[i]);
+            for (unsigned l = 0; l < m; ++l)
+            {
+                const matrix_t& a = letter_matrix_set.at(letters[l]);
+                for (unsigned i = 0; i < n; ++i)
+                    for (auto& e : a[i])
+                        mu[l][i].emplace_back(e.first, zp::conv(e.second));
+            }
+        }
+        catch (const std::domain_error&) {
+            return 0;
+        }
+        // Echelon basis of the first block in Z/pZ: rows[k] is 1 on
+        // piv[k], and words[k] = (parent, letter) the word of rows[k].
+        std::vector<std::vector<zp::value_t>> rows;
+        std::vector<unsigned> piv;
+        std::vector<std::pair<unsigned, unsigned>> words;
+        auto reduce_zp = [&](std::vector<zp::value_t>& v, unsigned from) {
+            for (unsigned b = from; b < rows.size(); ++b)
+                if (v[piv[b]] != 0)
+                    zp::axpy(v.data(), rows[b].data(), n, v[piv[b]]);
+        };
+        auto insert_zp = [&](std::vector<zp::value_t>& v, unsigned from) {
+            reduce_zp(v, from);
+            unsigned p = 0;
+            for (; p < n && v[p] == 0; ++p)
+                ;
+            if (p == n)
+                return false;
+            zp::scale(v.data(), n, zp::inverse(v[p]));
+            rows.push_back(std::move(v));
+            piv.push_back(p);
+            return true;
+        };
+        if (!insert_zp(first, 0))
+            return 0;
+        words.emplace_back(0, m);
+        for (unsigned k = 0; k < rows.size() && rows.size() < n; ++k)
+        {
+            if (ctx_->poll())
+                return 0;
+            // The products of rows[k] by the letters, reduced in
+            // parallel by the current rows, then inserted in turn.
+            unsigned r = rows.size();
+            std::vector<std::vector<zp::value_t>> products(m, std::vector<zp::value_t>(n, 0));
+            #pragma omp parallel for schedule(dynamic)
+            for (unsigned l = 0; l < m; ++l)
+            {
+                auto& v = products[l];
+                for (unsigned i = 0; i < n; ++i)
+                {
+                    zp::value_t x = rows[k][i];
+                    if (x == 0)
+                        continue;
+                    uint32_t xp = zp::shoup(x);
+                    for (auto& e : mu[l][i])
+                        v[e.first] = zp::add(v[e.first], zp::mul_fixed(e.second, x, xp));
+                }
+                reduce_zp(v, 0);
+            }
+            for (unsigned l = 0; l < m && rows.size() < n; ++l)
+                if (insert_zp(products[l], r))
+                    words.emplace_back(k, l);
+        }
+        rows.clear();
+        rows.shrink_to_fit();
+
+        // The vectors of the words over Q, then a Gauss-Jordan
+        // elimination on their pivots, which are in the first block.
+        unsigned r = words.size();
+        basis_t seeds(r);
+        seeds[0] = basis_vector_t(init);
+        for (unsigned k = 1; k < r; ++k)
+        {
+            seeds[k] = basis_vector_t(dimension);
+            type_t::product_vector_matrix(this, seeds[words[k].first],
+                                          letter_matrix_set.at(letters[words[k].second]),
+                                          seeds[k]);
+        }
+        for (unsigned k = 0; k < r; ++k)
+        {
+            if (ctx_->poll())
+                return 0;
+            unsigned pivot = type_t::find_pivot(this, seeds[k], k, permutation);
+            std::swap(permutation[pivot], permutation[k]);
+            type_t::normalisation_vector(this, seeds[k], k, permutation);
+            #pragma omp parallel for schedule(dynamic, 16)
+            for (unsigned j = k + 1; j < r; ++j)
+                type_t::reduce_vector(this, seeds[k], seeds[j], k, permutation);
+        }
+        type_t::bottom_up_reduction(this, seeds, permutation);
+        if (ctx_->poll())
+            return 0;
+        for (unsigned k = 0; k < r; ++k)
+            basis[k] = std::move(seeds[k]);
+        return r;
     }
 
     /** Core algorithm
@@ -540,9 +1322,10 @@ public:
         using type_t = select<weightset_t>;
 
         linear_representation();
+        auto start = std::chrono::steady_clock::now();
         // The basis is a list of vectors, each vector is associated with
         // a state of the output
-        std::vector<vector_t> basis;
+        basis_t basis;
         std::atomic<unsigned> basissize{0};
         basis.resize(dimension);
         // work to do
@@ -555,28 +1338,50 @@ public:
         unsigned* permutation = new unsigned[dimension];
         for (unsigned i = 0; i < dimension; ++i)
             permutation[i] = i;
-        // If the initial vector is null, the function immediatly returns
-
-        // A non zero entry is chosen as pivot
-        unsigned pivot = type_t::find_pivot(this, init, 0, permutation);
-        if (pivot == dimension) //all components of init are 0
-            return;
-        // The pivot of the first basis vector is permutation[0];
-        permutation[0] = pivot;
-        permutation[pivot] = 0;
-        // The initial vector is the first element of the new basis
-        // (up to the normalisation w.r.t the pivot)
-        vector_t first(init);
-        type_t::normalisation_vector(this, first, 0, permutation);
-        basis[0]=first;
-        basissize.fetch_add(1);
-        // Prepare work list
         std::vector<label_t> letters;
         unsigned m = letter_matrix_set.size();
         for (auto &mu : letter_matrix_set)
             letters.push_back(mu.first);
-        for (unsigned i=0; i<m; i++)
-            todo.push_back(std::make_pair(0,i));
+        // The reduction of a sum starts from the seeds of the first
+        // block, the initial vector being the first of them.
+        unsigned seeded = 0;
+        if constexpr (std::is_same<weightset_t, gmpq>::value)
+            if (other_)
+            {
+                seeded = seed_first_block(basis, permutation, letters);
+                if (verbose_)
+                    ctx_->log() << "[seeds: " << seeded << "/" << block_ << ", "
+                              << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+                              << "s]" << std::endl;
+            }
+        if (seeded == 0)
+        {
+            for (unsigned i = 0; i < dimension; ++i)
+                permutation[i] = i;
+            // If the initial vector is null, the function immediatly returns
+
+            // A non zero entry is chosen as pivot
+            basis_vector_t first(init);
+            unsigned pivot = type_t::find_pivot(this, first, 0, permutation);
+            if (pivot == dimension) //all components of init are 0
+            {
+                delete[] permutation;
+                return;
+            }
+            // The pivot of the first basis vector is permutation[0];
+            permutation[0] = pivot;
+            permutation[pivot] = 0;
+            // The initial vector is the first element of the new basis
+            // (up to the normalisation w.r.t the pivot)
+            type_t::normalisation_vector(this, first, 0, permutation);
+            basis[0]=first;
+            seeded = 1;
+        }
+        basissize.store(seeded);
+        // Prepare work list
+        for (unsigned b = 0; b < seeded; ++b)
+            for (unsigned i=0; i<m; i++)
+                todo.push_back(std::make_pair(b,i));
         // To each vector of the basis, all the successor vectors are
         // computed, reduced to respect to the basis, and finally, if
         // linearly independant, pushed at the end of the basis
@@ -589,20 +1394,34 @@ public:
                 unsigned imu;
                 unsigned cur;
 
-                std::cout << "[starting left_reduce with " << omp_get_num_threads() << " threads]" << std::endl;
+                if (verbose_)
+                    ctx_->log() << "[starting left_reduce with " << num_threads() << " threads]" << std::endl;
 
                 while (true) {
+                    // On cancellation, no more task is created and the
+                    // pending ones return at once.
+                    if (ctx_->poll())
+                        break;
                     {
                         bool isempty = false;
+                        // active_tasks must be read before todo: a task
+                        // pushes its successors before it terminates.
+                        bool idle = active_tasks == 0;
                         {
                             std::lock_guard<std::mutex> lock(mtx);
                             isempty = todo.empty();
                         }
-                        if (isempty && active_tasks == 0) {
+                        if (isempty && idle) {
                             break;
                         }
                         if (isempty) {
-                            #pragma omp taskyield // laisse le thread exécuter des tâches en attente
+                            // laisse le thread exécuter des tâches en attente
+                            // (taskyield ne suffit pas avec un seul thread)
+                            if (num_threads() > 1) {
+                                #pragma omp taskyield
+                            } else {
+                                #pragma omp taskwait
+                            }
                             continue;
                         }
                         {
@@ -615,12 +1434,15 @@ public:
                     }
 
                     #pragma omp task firstprivate(nb,imu,cur)
+                    if (ctx_->stopped())
+                        active_tasks--;
+                    else
                     {
-                        unsigned prev = 0;
                         label_t mu = letters[imu];
                         // All the vectors basis[nb].mu(a) are processed
-                        vector_t current(dimension);
-                        product_vector_matrix(basis[nb], letter_matrix_set[mu], current);
+                        unsigned prev = 0;
+                        basis_vector_t current(dimension);
+                        type_t::product_vector_matrix(this, basis[nb], letter_matrix_set.at(mu), current);
                         unsigned* mypermutation = new unsigned[dimension];
                         while (true) {
                             {
@@ -646,12 +1468,12 @@ public:
                             {
                                 std::lock_guard<std::mutex> lock(mtx);
                                 if (basissize.load() == cur) {
-                                    if (cur%100 == 0) {
-                                        std::cout << nb << "/" << cur << "/" << active_tasks ;
-                                        std::cout.flush();
-                                    } else if (cur % 10 == 0) {
-                                        std::cout << ".";
-                                        std::cout.flush();
+                                    if (verbose_ && cur%100 == 0) {
+                                        ctx_->log() << nb << "/" << cur << "/" << active_tasks ;
+                                        ctx_->log().flush();
+                                    } else if (verbose_ && cur % 10 == 0) {
+                                        ctx_->log() << ".";
+                                        ctx_->log().flush();
                                     }
                                     basis[cur] = current;
                                     basissize.fetch_add(1);
@@ -670,12 +1492,31 @@ public:
             }
             #pragma omp taskwait
         }
+        if (ctx_->stopped())
+        {
+            delete[] permutation;
+            ctx_->check();
+        }
         basis.resize(basissize.load());
-        std::cout << basissize.load() << std::endl;
+        if (verbose_)
+            ctx_->log() << basissize.load() << std::endl;
 
         // now, we use each vector to reduce the preceding vectors in
         // the basis.  If weightset=Z we do not do it.
         type_t::bottom_up_reduction(this, basis, permutation);
+        if (ctx_->stopped())
+        {
+            delete[] permutation;
+            ctx_->check();
+        }
+
+        size_t nlimbs = 0;
+        for (auto& vb : basis)
+            nlimbs += limbs(vb);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (verbose_)
+            ctx_->log() << "[pivot " << to_string(strategy_) << ": " << nlimbs
+                      << " limbs, " << elapsed.count() << "s]" << std::endl;
 
         // Construction of the output automaton
         // 1. States
@@ -684,29 +1525,51 @@ public:
             states[b] = res_->add_state();
         // 2. Initial vector
         vector_t vect_new_basis(basis.size());
-        type_t::vector_in_new_basis(this, basis, init,
+        basis_vector_t initial(init);
+        type_t::vector_in_new_basis(this, basis, initial,
                                     vect_new_basis, permutation);
         for (unsigned b = 0; b < basis.size(); ++b)
             res_->set_initial(states[b], vect_new_basis[b]);
         // 3. Each vector of the basis is a state; computation of the
-        // final function and the successor function
+        // final function and the successor function.  The vectors are
+        // processed in parallel, each one in its own list of outgoing
+        // transitions; the lists are then added to the output in order.
+        using out_transition_t = std::tuple<unsigned, label_t, weight_t>;
+        std::vector<weight_t> finals(basis.size());
+        std::vector<std::vector<out_transition_t>> outs(basis.size());
+        #pragma omp parallel for schedule(dynamic)
         for (unsigned v = 0; v < basis.size(); ++v)
         {
-            weight_t k = scalar_product(basis[v],final);
-            if(!ws_.is_zero(k))
-                res_->set_final(states[v],k);
-            for (auto mu : letter_matrix_set)
+            if (ctx_->poll())
+                continue;
+            vector_t coordinates(basis.size());
+            finals[v] = type_t::scalar_product(this, basis[v], final);
+            for (auto a : letters)
             {
-                // mu is a pair (letter,matrix).
-                vector_t current(dimension);
-                product_vector_matrix(basis[v], mu.second, current);
+                basis_vector_t current(dimension);
+                type_t::product_vector_matrix(this, basis[v], letter_matrix_set.at(a), current);
                 type_t::vector_in_new_basis(this, basis, current,
-                                            vect_new_basis, permutation);
+                                            coordinates, permutation);
                 for (unsigned b = 0; b < basis.size(); ++b)
-                    res_->new_transition(states[v], states[b],
-                                         mu.first, vect_new_basis[b]);
+                    if (!ws_.is_zero(coordinates[b]))
+                        outs[v].emplace_back(b, a, coordinates[b]);
             }
         }
+        if (ctx_->stopped())
+        {
+            delete[] permutation;
+            ctx_->check();
+        }
+        for (unsigned v = 0; v < basis.size(); ++v)
+        {
+            if(!ws_.is_zero(finals[v]))
+                res_->set_final(states[v],finals[v]);
+            for (auto& t : outs[v])
+                res_->new_transition(states[v], states[std::get<0>(t)],
+                                     std::get<1>(t), std::get<2>(t));
+            outs[v].clear();
+            outs[v].shrink_to_fit();
+        }
         delete[] permutation;
     }
 
@@ -721,25 +1584,390 @@ private:
     const weightset_t_of<automaton_t> ws_ = *input_->weightset();
 
     output_automaton_t res_;
+    // The second automaton of a sum, or null.
+    Other other_;
 
     // Linear representation of the input.
     unsigned dimension;
+    // Columns before block_ are preferred as pivots.
+    unsigned block_;
+    pivot_strategy strategy_ = pivot_strategy_from_env();
+    bool verbose_ = true;
+    exec_context* ctx_ = &exec_context::global();
+    // Number of non zero entries of each column (colcount).
+    std::vector<unsigned> col_count_;
     vector_t init;
     vector_t final;
     matrix_set_t letter_matrix_set;
+    // Common denominator of the matrices (gmpq).
+    mpz_class matrix_den_ = 1;
 
 };
 
+/// The automata of parts side by side (hence their sum), with their
+/// weights mapped to Z/pZ.
+template<typename Aut>
+auto zp_sum(const std::vector<Aut>& parts)
+{
+    using labelset_t = typename context_t_of<Aut>::labelset_t;
+    auto res = make_mutable_automaton(
+        context<labelset_t, zp>(*parts[0]->context().labelset(), zp()));
+    for (auto& a : parts)
+    {
+        std::unordered_map<state_t, state_t> m;
+        for (auto s : a->states())
+            m[s] = res->add_state();
+        for (auto t : a->initial_transitions())
+            res->set_initial(m[a->dst_of(t)], zp::conv(a->weight_of(t)));
+        for (auto t : a->final_transitions())
+            res->set_final(m[a->src_of(t)], zp::conv(a->weight_of(t)));
+        for (auto t : a->transitions())
+        {
+            auto w = zp::conv(a->weight_of(t));
+            if (!zp::is_zero(w))
+                res->add_transition(m[a->src_of(t)], m[a->dst_of(t)],
+                                    a->label_of(t), w);
+        }
+    }
+    return res;
+}
+
+}
+
+/// Dimensions of the two passes of the reduction of the sum of parts,
+/// computed in Z/pZ; they are never larger than the ones over Q, and
+/// equal unless p divides some minors of the Hankel matrix.  Throws
+/// std::domain_error if p divides a denominator.
+template<typename Aut>
+std::pair<unsigned, unsigned> estimate_dimension(const std::vector<Aut>& parts,
+                                               exec_context& ctx = exec_context::global())
+{
+    auto s = internal::zp_sum(parts);
+    auto tmp = transpose_view(s);
+    internal::reductioner<decltype(tmp), decltype(s)> algo(tmp);
+    algo.set_verbose(false);
+    algo.set_context(ctx);
+    algo.left_reduce();
+    auto tmp2 = transpose_view(algo.get_output());
+    internal::reductioner<decltype(tmp2), decltype(s)> algo2(tmp2);
+    algo2.set_verbose(false);
+    algo2.set_context(ctx);
+    algo2.left_reduce();
+    return {algo.get_output()->num_states(), algo2.get_output()->num_states()};
+}
+
+/// Prints the predicted dimension of the reduction of the sum of parts
+/// (over Q only) and checks the first pass, the largest basis that
+/// the exact reduction computes, against the budgets ABCOMP_WARN_DIM
+/// (a warning) and ABCOMP_MAX_DIM (stop_error, of reason size).  Nothing is
+/// done unless predict_from_env(): the tools call it once, before
+/// their main reduction.
+template<typename Aut>
+void check_dimension(const std::vector<Aut>& parts,
+                     exec_context& ctx = exec_context::global())
+{
+    if constexpr (std::is_same<weightset_t_of<Aut>, gmpq>::value)
+    {
+        if (!predict_from_env())
+            return;
+        unsigned warn = dimension_budget("ABCOMP_WARN_DIM");
+        unsigned max = dimension_budget("ABCOMP_MAX_DIM");
+        auto start = std::chrono::steady_clock::now();
+        std::pair<unsigned, unsigned> d;
+        auto engine = dimension_engine_from_env();
+        try {
+            if (engine == dimension_engine::krylov)
+            {
+                auto k = krylov::dimension(krylov::make_representation(parts), ctx);
+                ctx.log() << "[krylov: reachable " << k.reachable << ", co-reachable "
+                          << k.coreachable << "]" << std::endl;
+                d = {k.coreachable, k.minimal};
+            }
+            else
+                d = estimate_dimension(parts, ctx);
+        }
+        catch (const std::domain_error&) {
+            ctx.log() << "[predicted dimension: none]" << std::endl;
+            return;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        ctx.log() << "[predicted dimension: " << d.second << " (" << d.first
+                  << " after the first pass), " << elapsed.count() << "s]" << std::endl;
+        if (max != 0 && d.first > max)
+        {
+            std::cerr << "reduction of dimension " << d.first
+                      << " beyond ABCOMP_MAX_DIM=" << max << std::endl;
+            throw stop_error(stop_reason::size);
+        }
+        if (warn != 0 && d.first > warn)
+            std::cerr << "warning: reduction of dimension " << d.first
+                      << " beyond ABCOMP_WARN_DIM=" << warn << std::endl;
+    }
+}
+
+/*
+  Quotient of input by its coarsest forward bisimulation (exact
+  lumping): the states of a block have the same final weight and, for
+  every letter, the same total weight towards every block.  With
+  backward, the same on the mirror image: same initial weight and same
+  total weight from every block.  The series is preserved.
+
+  Partition refinement after Valmari and Franceschinis: the splitters
+  are blocks, the predecessors of a splitter are grouped by their
+  weights towards it, and a block split by a splitter enqueues all its
+  parts but the largest (the weights towards the last part follow from
+  the others).  Every state is in a processed splitter O(log n) times,
+  hence O(m log n) weight operations.  Only the exact operations of the
+  weightset are used; on the 0/1 automata of dfa_count, they are
+  operations on small integers.
+*/
+template<typename Aut>
+Aut lump(const Aut& input, bool backward = false,
+         exec_context& ctx = exec_context::global())
+{
+    using label_t = label_t_of<Aut>;
+    using weight_t = weight_t_of<Aut>;
+    const auto& ws = *input->weightset();
+    std::unordered_map<state_t, unsigned> index;
+    std::vector<state_t> states;
+    for (auto s : input->states())
+    {
+        index[s] = states.size();
+        states.push_back(s);
+    }
+    unsigned n = states.size();
+    // Entry and exit weights, and the edges, in the direction of the
+    // refinement.
+    std::vector<weight_t> entry(n, ws.zero()), exit(n, ws.zero());
+    for (auto t : input->initial_transitions())
+        entry[index[input->dst_of(t)]] = input->weight_of(t);
+    for (auto t : input->final_transitions())
+        exit[index[input->src_of(t)]] = input->weight_of(t);
+    if (backward)
+        std::swap(entry, exit);
+    struct edge
+    {
+        unsigned src;
+        label_t label;
+        unsigned dst;
+        weight_t weight;
+    };
+    std::vector<edge> edges;
+    for (auto t : input->transitions())
+    {
+        unsigned p = index[input->src_of(t)], q = index[input->dst_of(t)];
+        if (backward)
+            std::swap(p, q);
+        edges.push_back({p, input->label_of(t), q, input->weight_of(t)});
+    }
+    // The edges into each state.
+    std::vector<unsigned> pred_start(n + 1, 0), pred(edges.size());
+    for (auto& e : edges)
+        ++pred_start[e.dst + 1];
+    for (unsigned q = 0; q < n; ++q)
+        pred_start[q + 1] += pred_start[q];
+    {
+        std::vector<unsigned> cursor(pred_start.begin(), pred_start.end() - 1);
+        for (unsigned k = 0; k < edges.size(); ++k)
+            pred[cursor[edges[k].dst]++] = k;
+    }
+
+    auto wless = [&ws](const weight_t& x, const weight_t& y) {
+        return ws.less_than(x, y);
+    };
+    using signature_t = std::vector<std::pair<label_t, weight_t>>;
+    auto sless = [&ws](const signature_t& x, const signature_t& y) {
+        for (unsigned i = 0; i < x.size() && i < y.size(); ++i)
+        {
+            if (x[i].first != y[i].first)
+                return x[i].first < y[i].first;
+            if (!ws.equals(x[i].second, y[i].second))
+                return ws.less_than(x[i].second, y[i].second);
+        }
+        return x.size() < y.size();
+    };
+
+    // The partition: the block of each state, the states of each block
+    // and the position of each state among them.  The initial blocks
+    // are the exit weights.
+    std::vector<unsigned> block(n), pos(n);
+    std::vector<std::vector<unsigned>> members;
+    {
+        std::map<weight_t, unsigned, decltype(wless)> blocks(wless);
+        for (unsigned p = 0; p < n; ++p)
+        {
+            auto it = blocks.emplace(exit[p], members.size()).first;
+            if (it->second == members.size())
+                members.emplace_back();
+            block[p] = it->second;
+            pos[p] = members[block[p]].size();
+            members[block[p]].push_back(p);
+        }
+    }
+    std::deque<unsigned> splitters;
+    std::vector<char> queued(members.size(), 1);
+    for (unsigned b = 0; b < members.size(); ++b)
+        splitters.push_back(b);
+
+    while (!splitters.empty())
+    {
+        ctx.check();
+        unsigned c = splitters.front();
+        splitters.pop_front();
+        queued[c] = 0;
+        // Weights of the predecessors towards c, by letter.
+        std::unordered_map<unsigned, std::map<label_t, weight_t>> towards;
+        for (unsigned q : members[c])
+            for (unsigned k = pred_start[q]; k < pred_start[q + 1]; ++k)
+            {
+                const edge& e = edges[pred[k]];
+                auto& m = towards[e.src];
+                auto it = m.find(e.label);
+                if (it == m.end())
+                    m.emplace(e.label, e.weight);
+                else
+                    it->second = ws.add(it->second, e.weight);
+            }
+        // The predecessors grouped by block and signature; a zero
+        // signature is the one of the states without predecessors.
+        std::map<unsigned, std::map<signature_t, std::vector<unsigned>,
+                                    decltype(sless)>> groups;
+        for (auto& pw : towards)
+        {
+            signature_t sig;
+            for (auto& aw : pw.second)
+                if (!ws.is_zero(aw.second))
+                    sig.emplace_back(aw.first, aw.second);
+            if (sig.empty())
+                continue;
+            groups.try_emplace(block[pw.first], sless).first->second[sig]
+                .push_back(pw.first);
+        }
+        for (auto& bg : groups)
+        {
+            unsigned b = bg.first;
+            std::vector<std::vector<unsigned>*> parts;
+            size_t moved = 0;
+            for (auto& g : bg.second)
+            {
+                parts.push_back(&g.second);
+                moved += g.second.size();
+            }
+            // Without other states, the largest group stays in b.
+            if (moved == members[b].size())
+            {
+                auto largest = std::max_element(parts.begin(), parts.end(),
+                                                [](auto x, auto y) { return x->size() < y->size(); });
+                parts.erase(largest);
+            }
+            if (parts.empty())
+                continue;
+            std::vector<unsigned> created;
+            for (auto part : parts)
+            {
+                unsigned nb = members.size();
+                members.emplace_back();
+                queued.push_back(0);
+                for (unsigned p : *part)
+                {
+                    auto& from = members[b];
+                    pos[from.back()] = pos[p];
+                    from[pos[p]] = from.back();
+                    from.pop_back();
+                    block[p] = nb;
+                    pos[p] = members[nb].size();
+                    members[nb].push_back(p);
+                }
+                created.push_back(nb);
+            }
+            if (queued[b])
+            {
+                for (unsigned nb : created)
+                {
+                    queued[nb] = 1;
+                    splitters.push_back(nb);
+                }
+                continue;
+            }
+            created.push_back(b);
+            auto largest = std::max_element(created.begin(), created.end(),
+                                            [&](unsigned x, unsigned y) {
+                                                return members[x].size() < members[y].size();
+                                            });
+            for (unsigned nb : created)
+                if (nb != *largest)
+                {
+                    queued[nb] = 1;
+                    splitters.push_back(nb);
+                }
+        }
+    }
+
+    // The quotient, built from a representative of each block.
+    auto res = make_mutable_automaton(input->context());
+    std::vector<state_t> qs(members.size());
+    std::vector<weight_t> entries(members.size(), ws.zero());
+    for (unsigned b = 0; b < members.size(); ++b)
+        qs[b] = res->add_state();
+    for (unsigned p = 0; p < n; ++p)
+        entries[block[p]] = ws.add(entries[block[p]], entry[p]);
+    std::map<std::tuple<unsigned, label_t, unsigned>, weight_t> weights;
+    for (auto& e : edges)
+        if (members[block[e.src]][0] == e.src)
+        {
+            auto key = std::make_tuple(block[e.src], e.label, block[e.dst]);
+            auto it = weights.find(key);
+            if (it == weights.end())
+                weights.emplace(key, e.weight);
+            else
+                it->second = ws.add(it->second, e.weight);
+        }
+    for (unsigned b = 0; b < members.size(); ++b)
+    {
+        const weight_t& in = entries[b];
+        const weight_t& out = exit[members[b][0]];
+        if (!ws.is_zero(backward ? out : in))
+            res->set_initial(qs[b], backward ? out : in);
+        if (!ws.is_zero(backward ? in : out))
+            res->set_final(qs[b], backward ? in : out);
+    }
+    for (auto& kw : weights)
+        if (!ws.is_zero(kw.second))
+        {
+            unsigned b = std::get<0>(kw.first), c = std::get<2>(kw.first);
+            if (backward)
+                std::swap(b, c);
+            res->new_transition(qs[b], qs[c], std::get<1>(kw.first), kw.second);
+        }
+    return res;
 }
 
+/// Forward then backward lumping of input, with a log line.
 template<typename Aut>
-Aut reduce(const Aut& input)
+Aut lump_both(const Aut& input, exec_context& ctx = exec_context::global())
 {
-    auto tmp = transpose_view(input);
+    auto start = std::chrono::steady_clock::now();
+    auto fwd = lump(input, false, ctx);
+    auto res = lump(fwd, true, ctx);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    ctx.log() << "[lumping: " << input->num_states() << " -> " << fwd->num_states()
+              << " -> " << res->num_states() << " states, " << elapsed.count()
+              << "s]" << std::endl;
+    return res;
+}
+
+template<typename Aut>
+Aut reduce(const Aut& input, exec_context& ctx = exec_context::global())
+{
+    // the Gaussian elimination starts from the lumped automaton
+    Aut lumped = lump_from_env() ? lump_both(input, ctx) : input;
+    auto tmp = transpose_view(lumped);
     internal::reductioner<decltype(tmp), Aut> algo(tmp);
+    algo.set_context(ctx);
     algo.left_reduce();
     auto tmp2=transpose_view(algo.get_output());
     internal::reductioner<decltype(tmp2), Aut> algo2(tmp2);
+    algo2.set_context(ctx);
     algo2.left_reduce();
     auto ret=copy(algo2.get_output());
     if(ret->num_states() >= input->num_states())
@@ -755,10 +1983,77 @@ Aut reduce(const Aut& input)
     return ret;
 }
 
+/// Reduction of a view (see views.hh), which is read without being
+/// copied: the first pass is a left reduction of the view itself, and
+/// its output, an automaton of type Out, is then reduced.
+template<typename Out, typename View>
+Out reduce_view(const View& input, exec_context& ctx = exec_context::global())
+{
+    internal::reductioner<View, Out> algo(input);
+    algo.set_context(ctx);
+    algo.left_reduce();
+    return reduce(algo.get_output(), ctx);
+}
+
+namespace internal
+{
+/// The sum of s1 and s2 (an automaton or a view), built.
+template<typename Aut, typename Other>
+Aut sum_of(const Aut& s1, const Other& s2)
+{
+    auto res = copy(s1);
+    std::unordered_map<state_t, state_t> m;
+    for (auto s : s2->states())
+        m[s] = res->add_state();
+    for (auto t : s2->initial_transitions())
+        res->add_initial(m[s2->dst_of(t)], s2->weight_of(t));
+    for (auto t : s2->final_transitions())
+        res->add_final(m[s2->src_of(t)], s2->weight_of(t));
+    for (auto t : s2->transitions())
+        res->add_transition(m[s2->src_of(t)], m[s2->dst_of(t)],
+                            s2->label_of(t), s2->weight_of(t));
+    return res;
+}
+}
+
+/// Reduction of s1+s2 where s1 and s2 are already reduced: the sum
+/// is never built, and the first pass starts from a basis of the span
+/// of s1 (see reductioner::seed_first_block), so that only the part of
+/// the span of s2 which is not already given by s1 is explored.  s2
+/// may be a view (e.g. opposite_view(s) for s1-s): the first pass is
+/// the left reduction of the sum itself, and the second one of its
+/// transpose.
+template<typename Aut, typename Other>
+Aut reduce_difference(const Aut& s1, const Other& s2,
+                      exec_context& ctx = exec_context::global())
+{
+    internal::reductioner<Aut, Aut, Other> algo(s1, s2);
+    algo.set_context(ctx);
+    algo.left_reduce();
+    auto tmp=transpose_view(algo.get_output());
+    internal::reductioner<decltype(tmp), Aut> algo2(tmp);
+    algo2.set_context(ctx);
+    algo2.left_reduce();
+    Aut ret=copy(transpose_view(algo2.get_output()));
+    if(ret->num_states() >= s1->num_states() + s2->num_states())
+        ret= internal::sum_of(s1, s2);
+    if(!s1->get_name().empty() && !s2->get_name().empty()) {
+        std::string name = s1->get_name() + "+" + s2->get_name();
+        ret->set_desc("Reduction of "+name);
+        ret->set_name("red-"+name);
+    }
+    else {
+        ret->set_desc("Reduction");
+        ret->set_name("red");
+    }
+    return ret;
+}
+
 template<typename Aut>
-Aut left_reduce(const Aut& input)
+Aut left_reduce(const Aut& input, exec_context& ctx = exec_context::global())
 {
     internal::reductioner<decltype(input), Aut> algo(input);
+    algo.set_context(ctx);
     algo.left_reduce();
     return copy(algo.get_output());
 }
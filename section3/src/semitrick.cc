@@ -0,0 +1,168 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+
+#include "gmpq.hh"
+#include "reduce.hh"
+#include <awali/sttc/algos/sum.hh>
+#include <awali/sttc/algos/determinize.hh>
+#include <awali/sttc/algos/complete.hh>
+#include "walnut.hh"
+
+
+using namespace std;
+using namespace awali::sttc;
+using namespace dfa;
+
+using weightset_t = gmpq;
+using labelset_t = ctx::lal_int;
+using context_t = context<labelset_t, weightset_t>;
+using automaton_t = mutable_automaton<context_t>;
+
+auto now() {
+    return chrono::steady_clock::now();
+}
+
+void log_duration(ostream& out, const std::string& label, std::chrono::steady_clock::time_point start) {
+    using namespace std;
+    auto end = chrono::steady_clock::now();
+    auto duration_ms = chrono::duration_cast<chrono::milliseconds>(end - start).count();
+
+    long long total_seconds = duration_ms / 1000;
+
+    out << label << " ";
+
+    if (total_seconds < 60) {
+        // Format : 4.321s
+        out << fixed << setprecision(3) << (duration_ms / 1000.0) << "s";
+    } else {
+        int hours = static_cast<int>(total_seconds / 3600);
+        int minutes = static_cast<int>((total_seconds % 3600) / 60);
+        int seconds = static_cast<int>(total_seconds % 60);
+
+        if (hours > 0)
+            out << hours << ":" << setfill('0') << setw(2);
+        out << minutes << ":" << setfill('0') << setw(2) << seconds;
+    }
+
+    out << endl;
+}
+
+struct job {
+    string mpl, ns, dest;
+};
+
+/// The semigroup trick on one linear representation: reduce it, then
+/// explore its reachable vectors, which are the states of the DFAO.
+/// The job runs in its own context (its budgets of time and states),
+/// which also collects the log lines of the stages; the log is
+/// returned to be printed in one piece.
+string semitrick(const job& j) {
+    ostringstream log;
+    exec_context ctx(exec_context::global());
+    ctx.max_kib = 0;
+    ctx.set_log(log);
+    log << "* " << j.mpl << endl;
+
+    auto t0 = now();
+    automaton_t s;
+    LabelMapper al;
+    vector<string> names;
+    tie(s, al) = mpl_from_walnut(j.mpl, &names);
+    log << "Chargement: " << s->num_states() << " states, " << s->num_transitions() << " transitions" << endl;
+    log_duration(log, ">>>", t0);
+
+    t0 = now();
+    check_dimension(vector<automaton_t>{s}, ctx);
+    auto red = reduce(s, ctx);
+    log << "Réduction: " << red->num_states() << " states, " << red->num_transitions() << " transitions" << endl;
+    log_duration(log, ">>>", t0);
+
+    t0 = now();
+    automaton_t t;
+    try {
+        t = explore_vectors(red, ctx);
+    } catch (const stop_error&) {
+        // the reduced representation, for a later run
+        ofstream partial(j.dest + ".partial.mpl");
+        to_mpl(red, al, partial, names);
+        throw;
+    }
+    complete_here(t);
+    log << "Exploration: " << t->num_states() << " states, " << t->num_transitions() << " transitions" << endl;
+    log_duration(log, ">>>", t0);
+
+    t0 = now();
+    ofstream fout(j.dest);
+    if (!fout)
+        throw runtime_error("Cannot open file: " + j.dest);
+    to_walnut(t, al, fout, j.ns);
+    log << "Écriture de " << j.dest << endl;
+    log_duration(log, ">>>", t0);
+
+    return log.str();
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4 || (argc - 1) % 3 != 0) {
+        cerr << "Usage: " << argv[0] << " comp.mpl ns Comp.txt [comp.mpl ns Comp.txt ...]\n"
+             << "  where comp.mpl is a linear representation written by Walnut's eval,\n"
+             << "  ns its numeration system and Comp.txt the output DFAO\n"
+             << "  (the triples are processed concurrently)\n";
+        return 1;
+    }
+
+    vector<job> jobs;
+    for (int i = 1; i < argc; i += 3)
+        jobs.push_back({argv[i], argv[i + 1], argv[i + 2]});
+
+    // The largest representations first, as the jobs are scheduled
+    // dynamically.
+    auto size = [](const job& j) {
+        error_code ec;
+        auto n = filesystem::file_size(j.mpl, ec);
+        return ec ? 0 : n;
+    };
+    stable_sort(jobs.begin(), jobs.end(),
+                [&](const job& a, const job& b) { return size(a) > size(b); });
+
+    // ABCOMP_MAX_TIME and ABCOMP_MAX_STATES are budgets of each job,
+    // ABCOMP_MAX_MEM of the process, hence of all the jobs.
+    exec_context::global().max_seconds = 0;
+    exec_context::global().max_states = 0;
+    install_signal_handlers();
+    int status = 0;
+#ifdef USE_OPENMP
+    // The threads are shared among the jobs run at the same time: each
+    // one runs the parallel regions of its reductions on its own share.
+    int threads = omp_get_max_threads();
+    int outer = min<int>(jobs.size(), threads);
+    omp_set_max_active_levels(2);
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(outer) reduction(max:status)
+#endif
+    for (size_t i = 0; i < jobs.size(); ++i) {
+#ifdef USE_OPENMP
+        omp_set_num_threads(max(1, threads / outer));
+#endif
+        string log;
+        try {
+            log = semitrick(jobs[i]);
+        } catch (const stop_error& e) {
+            log = "* " + jobs[i].mpl + "\nstopped: " + e.what() + "\n";
+            status = max(status, exit_status(e.reason));
+        } catch (const exception& e) {
+            log = "* " + jobs[i].mpl + "\nerror: " + e.what() + "\n";
+            status = max(status, 1);
+        }
+        #pragma omp critical
+        cout << log << endl;
+    }
+
+    return status;
+}
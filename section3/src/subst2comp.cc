@@ -0,0 +1,266 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <random>
+
+#include "context.hh"
+
+
+using namespace std;
+using namespace awali::sttc;
+
+auto now() {
+    return chrono::steady_clock::now();
+}
+
+void log_duration(const std::string& label, std::chrono::steady_clock::time_point start) {
+    using namespace std;
+    auto end = chrono::steady_clock::now();
+    auto duration_ms = chrono::duration_cast<chrono::milliseconds>(end - start).count();
+
+    long long total_seconds = duration_ms / 1000;
+
+    cout << label << " ";
+
+    if (total_seconds < 60) {
+        // Format : 4.321s
+        cout << fixed << setprecision(3) << (duration_ms / 1000.0) << "s";
+    } else {
+        int hours = static_cast<int>(total_seconds / 3600);
+        int minutes = static_cast<int>((total_seconds % 3600) / 60);
+        int seconds = static_cast<int>(total_seconds % 60);
+
+        if (hours > 0)
+            cout << hours << ":" << setfill('0') << setw(2);
+        cout << minutes << ":" << setfill('0') << setw(2) << seconds;
+    }
+
+    cout << endl << endl;
+}
+
+using factor_t = uint16_t;
+
+/// The prefix of length L of the fixed point of subst (the syntax of
+/// section4/gen_abcomp.py: "01/02/0" is 0 -> 01, 1 -> 02, 2 -> 0).
+vector<uint8_t> fixed_point(const string& subst, size_t L) {
+    vector<vector<uint8_t>> h(1);
+    for (char c : subst) {
+        if (c == '/')
+            h.emplace_back();
+        else if (c >= '0' && c <= '9')
+            h.back().push_back(c - '0');
+        else
+            throw runtime_error("bad substitution: " + subst);
+    }
+    for (const auto& img : h)
+        for (auto a : img)
+            if (a >= h.size())
+                throw runtime_error("bad substitution: " + subst);
+    if (h[0].size() < 2 || h[0][0] != 0)
+        throw runtime_error("the substitution has no fixed point starting with 0");
+    vector<uint8_t> w(h[0]);
+    w.reserve(L + h.size() * 16);
+    for (size_t i = 1; w.size() < L; ++i) {
+        if (i >= w.size())
+            throw runtime_error("the fixed point is finite");
+        w.insert(w.end(), h[w[i]].begin(), h[w[i]].end());
+    }
+    w.resize(L);
+    return w;
+}
+
+/*
+  The factors of length k of the word: fid[i] is the number of the
+  factor at i, for i <= L-k, and prefix[f] the number of the prefix of
+  length k-1 of the factor f.  The factors of length k+1 are the pairs
+  (factor of length k at i, letter at i+k), numbered in the order of
+  these pairs, so that the update is in place and parallel.
+*/
+struct factors {
+    vector<factor_t> fid;
+    vector<factor_t> prefix;
+    size_t count;
+    size_t k;
+    size_t letters;
+
+    explicit factors(const vector<uint8_t>& w)
+        : fid(w.begin(), w.end()), k(1), letters(0)
+    {
+        for (auto a : w)
+            letters = max(letters, size_t(a) + 1);
+        count = letters;
+        prefix.assign(count, 0);
+    }
+
+    void extend(const vector<uint8_t>& w, exec_context& ctx) {
+        size_t n = w.size() - k;
+        vector<char> used(count * letters, 0);
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < n; ++i)
+            used[size_t(fid[i]) * letters + w[i + k]] = 1;
+        ctx.check();
+        vector<size_t> num(used.size());
+        size_t c = 0;
+        prefix.clear();
+        for (size_t p = 0; p < used.size(); ++p)
+            if (used[p]) {
+                num[p] = c++;
+                prefix.push_back(p / letters);
+            }
+        if (c > numeric_limits<factor_t>::max())
+            throw runtime_error("too many factors of length " + to_string(k + 1));
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < n; ++i)
+            fid[i] = num[size_t(fid[i]) * letters + w[i + k]];
+        fid.resize(n);
+        count = c;
+        ++k;
+    }
+};
+
+/*
+  The number of k-abelian classes of the factors of length n >= k: the
+  window [i, i+n) slides along the word, and its class is its prefix of
+  length k-1 with the counts of the factors of length k in the window,
+  updated when the window moves (one factor leaves, one comes in).  The
+  classes are hashed by sum_f count[f].r[f] for random r, which moves
+  with the counts, in a table with open addressing, and compared
+  exactly on equal hashes.
+*/
+size_t classes(const factors& F, size_t n, const vector<uint64_t>& r,
+               const vector<uint64_t>& rp, exec_context& ctx) {
+    size_t k = F.k, d = F.count;
+    size_t last = F.fid.size() + k - n;  // number of windows
+    vector<int> cnt(d, 0);
+    uint64_t h = 0;
+    for (size_t j = 0; j + k <= n; ++j) {
+        ++cnt[F.fid[j]];
+        h += r[F.fid[j]];
+    }
+    // open addressing on the hash: the slots hold the hash and the
+    // offset in seen of the class, or -1
+    vector<pair<uint64_t, long>> slots(64, {0, -1});
+    vector<int> seen;  // prefix, then counts, for each class
+    size_t res = 0;
+    for (size_t i = 0; i < last; ++i) {
+        if (i > 0) {
+            factor_t out = F.fid[i - 1], in = F.fid[i + n - k];
+            --cnt[out];
+            ++cnt[in];
+            h += r[in] - r[out];
+        }
+        if ((i & 0xfffff) == 0 && ctx.poll())
+            return 0;
+        int pre = F.prefix[F.fid[i]];
+        uint64_t key = h + rp[pre];
+        size_t mask = slots.size() - 1, s = (key ^ (key >> 29)) & mask;
+        for (;; s = (s + 1) & mask) {
+            auto [sk, c] = slots[s];
+            if (c < 0)
+                break;
+            if (sk == key && seen[c] == pre
+                && equal(cnt.begin(), cnt.end(), seen.begin() + c + 1))
+                break;
+        }
+        if (slots[s].second >= 0)
+            continue;
+        slots[s] = {key, long(seen.size())};
+        seen.push_back(pre);
+        seen.insert(seen.end(), cnt.begin(), cnt.end());
+        if (++res * 2 > slots.size()) {
+            vector<pair<uint64_t, long>> old(2 * slots.size(), {0, -1});
+            old.swap(slots);
+            mask = slots.size() - 1;
+            for (const auto& [ok, oc] : old)
+                if (oc >= 0) {
+                    size_t t = (ok ^ (ok >> 29)) & mask;
+                    while (slots[t].second >= 0)
+                        t = (t + 1) & mask;
+                    slots[t] = {ok, oc};
+                }
+        }
+    }
+    return res;
+}
+
+int main(int argc, char** argv) {
+    size_t L = 1000000;
+    int a = 1;
+    if (argc == 7 && string(argv[1]) == "-l") {
+        L = stoull(argv[2]);
+        a = 3;
+    }
+    if (argc != a + 4) {
+        cerr << "Usage: " << argv[0] << " [-l length] subst K N output\n"
+             << "  where subst is a substitution as in gen_abcomp.py (\"01/02/0\")\n"
+             << "  Output: the k-abelian complexity of the factors of length n of the prefix\n"
+             << "  of its fixed point (10^6 letters by default), for k = 1..K and n = 0..N,\n"
+             << "  one line per n\n";
+        return 1;
+    }
+
+    string subst = argv[a];
+    size_t K = stoul(argv[a + 1]);
+    size_t N = stoul(argv[a + 2]);
+    string output = argv[a + 3];
+
+    return run_tool([&]() {
+        auto& ctx = exec_context::global();
+        if (N >= L)
+            throw runtime_error("the prefix is shorter than N");
+
+        cout << "* Point fixe de " << subst << " (" << L << " lettres)" << endl;
+        auto t0 = now();
+        auto w = fixed_point(subst, L);
+        factors F(w);
+        log_duration(">>>", t0);
+
+        // comp[k-1][n]; for n < k, the k-abelian classes are the factors
+        vector<vector<size_t>> comp(K, vector<size_t>(N + 1));
+        vector<size_t> distinct{1};
+        mt19937_64 gen(0x6162636f6d70);
+        for (size_t k = 1; k <= K; ++k) {
+            cout << "k = " << k << endl;
+            t0 = now();
+            if (k > 1)
+                F.extend(w, ctx);
+            distinct.push_back(F.count);
+            vector<uint64_t> r(F.count), rp(distinct[k - 1]);
+            for (auto& x : r)
+                x = gen();
+            for (auto& x : rp)
+                x = gen();
+            for (size_t n = 0; n < k && n <= N; ++n)
+                comp[k - 1][n] = distinct[n];
+            #pragma omp parallel for schedule(dynamic, 1)
+            for (size_t n = k; n <= N; ++n)
+                comp[k - 1][n] = classes(F, n, r, rp, ctx);
+            ctx.check();
+            cout << F.count << " factors of length " << k << endl;
+            log_duration(">>>", t0);
+        }
+
+        cout << "Écriture de la sortie" << endl;
+        t0 = now();
+        ofstream fout(output);
+        if (!fout)
+            throw runtime_error("Cannot open file: " + output);
+        fout << "n";
+        for (size_t k = 1; k <= K; ++k)
+            fout << " " << k;
+        fout << "\n";
+        for (size_t n = 0; n <= N; ++n) {
+            fout << n;
+            for (size_t k = 1; k <= K; ++k)
+                fout << " " << comp[k - 1][n];
+            fout << "\n";
+        }
+        log_duration(">>>", t0);
+
+        return 0;
+    });
+}
@@ -0,0 +1,478 @@
+#ifndef ABCOMP_VIEWS_HH
+#define ABCOMP_VIEWS_HH
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <awali/sttc/core/mutable_automaton.hh>
+
+namespace awali {
+namespace sttc {
+
+/*
+  Views of automata, in the spirit of transpose_view: they offer the
+  reading interface of mutable_automaton that the reductioner, lump
+  and krylov::make_representation use (states, transitions, out,
+  initial and final transitions, src_of, dst_of, label_of, weight_of)
+  and compute it on the fly from the automata they refer to; nothing
+  is copied.  The ranges of states and transitions are lazy as well:
+  they are walked without being stored, and only the outgoing
+  transitions of one state at a time are built.  A view may have
+  several transitions with the same source, label and destination:
+  their weights add up.
+  - relabel_view: the labels mapped by a function;
+  - opposite_view: the initial weights negated;
+  - broadcast_view: in each state, the transitions of label z are
+    duplicated on every label going out of the state, and the other
+    ones are removed (as modify_transitions in walnut.hh);
+  - sum_view: the disjoint union of two automata.
+  The views are shared pointers, like the automata.
+*/
+namespace view {
+
+/// The elements of a range mapped by f, when they are read.
+template<typename Range, typename F>
+class mapped
+{
+    using inner_t = decltype(std::declval<Range&>().begin());
+
+public:
+    mapped(Range r, F f)
+        : r_(std::move(r)), f_(std::move(f))
+    {}
+
+    class iterator
+    {
+    public:
+        iterator(inner_t i, const F* f)
+            : i_(i), f_(f)
+        {}
+
+        auto operator*() const { return (*f_)(*i_); }
+        iterator& operator++() { ++i_; return *this; }
+        bool operator!=(const iterator& o) const { return i_ != o.i_; }
+
+    private:
+        inner_t i_;
+        const F* f_;
+    };
+
+    iterator begin() const { return {r_.begin(), &f_}; }
+    iterator end() const { return {r_.end(), &f_}; }
+
+private:
+    mutable Range r_;
+    F f_;
+};
+
+/// The elements of r1, then the ones of r2 (of the same type).
+template<typename Range1, typename Range2>
+class chained
+{
+    using inner1_t = decltype(std::declval<Range1&>().begin());
+    using inner2_t = decltype(std::declval<Range2&>().begin());
+
+public:
+    chained(Range1 r1, Range2 r2)
+        : r1_(std::move(r1)), r2_(std::move(r2))
+    {}
+
+    class iterator
+    {
+    public:
+        using value_t = typename std::decay<decltype(*std::declval<inner1_t>())>::type;
+
+        iterator(inner1_t i1, inner1_t e1, inner2_t i2)
+            : i1_(i1), e1_(e1), i2_(i2)
+        {}
+
+        value_t operator*() const { return i1_ != e1_ ? value_t(*i1_) : value_t(*i2_); }
+
+        iterator& operator++()
+        {
+            if (i1_ != e1_)
+                ++i1_;
+            else
+                ++i2_;
+            return *this;
+        }
+
+        bool operator!=(const iterator& o) const { return i1_ != o.i1_ || i2_ != o.i2_; }
+
+    private:
+        inner1_t i1_, e1_;
+        inner2_t i2_;
+    };
+
+    iterator begin() const { return {r1_.begin(), r1_.end(), r2_.begin()}; }
+    iterator end() const { return {r1_.end(), r1_.end(), r2_.end()}; }
+
+private:
+    mutable Range1 r1_;
+    mutable Range2 r2_;
+};
+
+/// The elements of the vectors f(x) for the elements x of a range,
+/// one vector at a time.
+template<typename Range, typename F>
+class flattened
+{
+    using inner_t = decltype(std::declval<Range&>().begin());
+    using vector_t = typename std::decay<decltype(std::declval<const F&>()(*std::declval<inner_t>()))>::type;
+
+public:
+    flattened(Range r, F f)
+        : r_(std::move(r)), f_(std::move(f))
+    {}
+
+    class iterator
+    {
+    public:
+        iterator(inner_t i, inner_t e, const F* f)
+            : i_(i), e_(e), f_(f)
+        {
+            fill();
+        }
+
+        const typename vector_t::value_type& operator*() const { return cur_[j_]; }
+
+        iterator& operator++()
+        {
+            ++j_;
+            fill();
+            return *this;
+        }
+
+        bool operator!=(const iterator& o) const
+        {
+            if (done() || o.done())
+                return done() != o.done();
+            return i_ != o.i_ || j_ != o.j_;
+        }
+
+    private:
+        bool done() const { return i_ == e_ && j_ == cur_.size(); }
+
+        /// The next non empty vector, if the current one is read.
+        void fill()
+        {
+            while (j_ == cur_.size() && i_ != e_)
+            {
+                cur_ = (*f_)(*i_);
+                ++i_;
+                j_ = 0;
+            }
+        }
+
+        inner_t i_, e_;
+        const F* f_;
+        vector_t cur_;
+        std::size_t j_ = 0;
+    };
+
+    iterator begin() const { return {r_.begin(), r_.end(), &f_}; }
+    iterator end() const { return {r_.end(), r_.end(), &f_}; }
+
+private:
+    mutable Range r_;
+    F f_;
+};
+
+/// Forwards the interface to the automaton.
+template<typename Aut>
+class forward
+{
+public:
+    using automaton_t = Aut;
+    /// The transitions of the automaton.
+    using inner_t = typename std::decay<decltype(*std::declval<Aut>()->transitions().begin())>::type;
+    using context_t = context_t_of<Aut>;
+    using labelset_t = labelset_t_of<context_t>;
+    using weightset_t = weightset_t_of<context_t>;
+    using label_t = label_t_of<context_t>;
+    using weight_t = weight_t_of<context_t>;
+
+    explicit forward(const Aut& a)
+        : a_(a)
+    {}
+
+    const context_t& context() const { return a_->context(); }
+    auto weightset() const { return a_->weightset(); }
+    auto labelset() const { return a_->labelset(); }
+    state_t pre() const { return a_->pre(); }
+    state_t post() const { return a_->post(); }
+    size_t num_states() const { return a_->num_states(); }
+    size_t num_transitions() const { return a_->num_transitions(); }
+    std::string get_name() const { return a_->get_name(); }
+    auto states() const { return a_->states(); }
+    auto transitions() const { return a_->transitions(); }
+    auto initial_transitions() const { return a_->initial_transitions(); }
+    auto final_transitions() const { return a_->final_transitions(); }
+    auto out(state_t s) const { return a_->out(s); }
+    // the transitions are the ones of the automaton (which may be a view)
+    template<typename T>
+    state_t src_of(const T& t) const { return a_->src_of(t); }
+    template<typename T>
+    state_t dst_of(const T& t) const { return a_->dst_of(t); }
+    template<typename T>
+    label_t label_of(const T& t) const { return a_->label_of(t); }
+    template<typename T>
+    weight_t weight_of(const T& t) const { return a_->weight_of(t); }
+
+protected:
+    Aut a_;
+};
+
+template<typename Aut>
+class relabel : public forward<Aut>
+{
+public:
+    using typename forward<Aut>::label_t;
+
+    relabel(const Aut& a, std::function<label_t(label_t)> f)
+        : forward<Aut>(a), f_(std::move(f))
+    {}
+
+    template<typename T>
+    label_t label_of(const T& t) const { return f_(this->a_->label_of(t)); }
+
+private:
+    std::function<label_t(label_t)> f_;
+};
+
+template<typename Aut>
+class opposite : public forward<Aut>
+{
+public:
+    using typename forward<Aut>::weight_t;
+    using forward<Aut>::forward;
+
+    template<typename T>
+    weight_t weight_of(const T& t) const
+    {
+        const auto& ws = *this->a_->weightset();
+        auto w = this->a_->weight_of(t);
+        return this->a_->src_of(t) == this->a_->pre() ? ws.sub(ws.zero(), w) : w;
+    }
+};
+
+template<typename Aut>
+class broadcast : public forward<Aut>
+{
+public:
+    using typename forward<Aut>::inner_t;
+    using typename forward<Aut>::label_t;
+    using typename forward<Aut>::weight_t;
+
+    /// A transition of label z of the automaton, carrying label.
+    struct transition
+    {
+        inner_t t;
+        label_t label;
+    };
+
+    broadcast(const Aut& a, label_t z)
+        : forward<Aut>(a), z_(z)
+    {}
+
+    size_t num_transitions() const
+    {
+        size_t n = 0;
+        for (auto s : this->a_->states())
+            n += out(s).size();
+        return n;
+    }
+
+    auto transitions() const
+    {
+        return flattened{this->a_->states(), [this](state_t s) { return out(s); }};
+    }
+
+    auto initial_transitions() const
+    {
+        return wrap(this->a_->initial_transitions());
+    }
+
+    auto final_transitions() const
+    {
+        return wrap(this->a_->final_transitions());
+    }
+
+    /// As modify_transitions, which adds the z-transitions to every
+    /// label of the state, z included: the z-transitions are there
+    /// twice.
+    std::vector<transition> out(state_t s) const
+    {
+        std::set<label_t> labels{z_};
+        std::vector<inner_t> zs;
+        for (auto t : this->a_->out(s))
+        {
+            labels.insert(this->a_->label_of(t));
+            if (this->a_->label_of(t) == z_)
+                zs.push_back(t);
+        }
+        std::vector<transition> res;
+        for (auto t : zs)
+            res.push_back({t, z_});
+        for (auto a : labels)
+            for (auto t : zs)
+                res.push_back({t, a});
+        return res;
+    }
+
+    state_t src_of(const transition& t) const { return this->a_->src_of(t.t); }
+    state_t dst_of(const transition& t) const { return this->a_->dst_of(t.t); }
+    label_t label_of(const transition& t) const { return t.label; }
+    weight_t weight_of(const transition& t) const { return this->a_->weight_of(t.t); }
+
+private:
+    template<typename Transitions>
+    auto wrap(Transitions ts) const
+    {
+        return mapped{std::move(ts), [this](const inner_t& t) {
+            return transition{t, this->a_->label_of(t)};
+        }};
+    }
+
+    label_t z_;
+};
+
+template<typename Aut>
+class sum : public forward<Aut>
+{
+public:
+    using typename forward<Aut>::inner_t;
+    using typename forward<Aut>::label_t;
+    using typename forward<Aut>::weight_t;
+
+    /// A transition of the first or of the second automaton.
+    struct transition
+    {
+        inner_t t;
+        bool second;
+    };
+
+    /// The states of b are shifted after the ones of a.
+    sum(const Aut& a, const Aut& b)
+        : forward<Aut>(a), b_(b)
+    {
+        offset_ = std::max(a->pre(), a->post());
+        for (auto s : a->states())
+            offset_ = std::max(offset_, s);
+        ++offset_;
+    }
+
+    size_t num_states() const { return this->a_->num_states() + b_->num_states(); }
+    size_t num_transitions() const { return this->a_->num_transitions() + b_->num_transitions(); }
+
+    auto states() const
+    {
+        state_t offset = offset_;
+        return chained{this->a_->states(),
+                       mapped{b_->states(), [offset](state_t s) { return s + offset; }}};
+    }
+
+    auto transitions() const
+    {
+        return concat(this->a_->transitions(), b_->transitions());
+    }
+
+    auto initial_transitions() const
+    {
+        return concat(this->a_->initial_transitions(), b_->initial_transitions());
+    }
+
+    auto final_transitions() const
+    {
+        return concat(this->a_->final_transitions(), b_->final_transitions());
+    }
+
+    std::vector<transition> out(state_t s) const
+    {
+        std::vector<transition> res;
+        if (s < offset_)
+            for (auto t : this->a_->out(s))
+                res.push_back({t, false});
+        else
+            for (auto t : b_->out(s - offset_))
+                res.push_back({t, true});
+        return res;
+    }
+
+    state_t src_of(const transition& t) const
+    {
+        return t.second ? map(b_->src_of(t.t)) : this->a_->src_of(t.t);
+    }
+
+    state_t dst_of(const transition& t) const
+    {
+        return t.second ? map(b_->dst_of(t.t)) : this->a_->dst_of(t.t);
+    }
+
+    label_t label_of(const transition& t) const
+    {
+        return t.second ? b_->label_of(t.t) : this->a_->label_of(t.t);
+    }
+
+    weight_t weight_of(const transition& t) const
+    {
+        return t.second ? b_->weight_of(t.t) : this->a_->weight_of(t.t);
+    }
+
+private:
+    /// A state of b in the view (pre and post are the ones of a).
+    state_t map(state_t s) const
+    {
+        if (s == b_->pre())
+            return this->a_->pre();
+        if (s == b_->post())
+            return this->a_->post();
+        return s + offset_;
+    }
+
+    template<typename T1, typename T2>
+    static auto concat(T1 t1, T2 t2)
+    {
+        return chained{mapped{std::move(t1), [](const inner_t& t) { return transition{t, false}; }},
+                       mapped{std::move(t2), [](const inner_t& t) { return transition{t, true}; }}};
+    }
+
+    Aut b_;
+    state_t offset_;
+};
+
+}
+
+template<typename Aut>
+auto relabel_view(const Aut& a, std::function<label_t_of<Aut>(label_t_of<Aut>)> f)
+{
+    return std::make_shared<view::relabel<Aut>>(a, std::move(f));
+}
+
+template<typename Aut>
+auto opposite_view(const Aut& a)
+{
+    return std::make_shared<view::opposite<Aut>>(a);
+}
+
+template<typename Aut>
+auto broadcast_view(const Aut& a, label_t_of<Aut> z)
+{
+    return std::make_shared<view::broadcast<Aut>>(a, z);
+}
+
+template<typename Aut>
+auto sum_view(const Aut& a, const Aut& b)
+{
+    return std::make_shared<view::sum<Aut>>(a, b);
+}
+
+}
+}
+
+#endif
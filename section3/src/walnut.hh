@@ -1,6 +1,10 @@
 #ifndef WALNUT_HH
 #define WALNUT_HH
 
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <deque>
 #include <map>
 #include <numeric>
 #include <unordered_map>
@@ -9,6 +13,7 @@
 #include <sstream>
 #include <fstream>
 #include <set>
+#include <tuple>
 #include <functional>
 #include <stdexcept>
 #include <iostream>
@@ -20,7 +25,10 @@
 #include <awali/sttc/algos/copy.hh>
 #include <awali/sttc/algos/product.hh>
 #include "reduce.hh"
+#include "views.hh"
 #include "gmpq.hh"
+#include "context.hh"
+#include "dfao.hh"
 
 using namespace awali;
 using namespace awali::sttc;
@@ -33,109 +41,25 @@ using context_t = context<labelset_t, weightset_t>;
 namespace dfa {
 
 
-struct VectorHash {
-    std::size_t operator()(const std::vector<int>& v) const {
-        std::size_t hash = 0;
-        for (int i : v) {
-            hash ^= std::hash<int> {}(i) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
-        }
-        return hash;
-    }
-};
-
-struct LabelMapper {
-public:
-    std::unordered_map<std::vector<int>, int, VectorHash> to_int;
-    std::vector<std::vector<int>> to_tuple;
-
-    int get(const std::vector<int>& tuple) {
-        auto it = to_int.find(tuple);
-        if (it != to_int.end())
-            return it->second;
-
-        int id = static_cast<int>(to_tuple.size());
-        to_tuple.push_back(tuple);
-        to_int[tuple] = id;
-        return id;
-    }
-
-    const std::vector<int>& operator[](int id) const {
-        return to_tuple[id];
-    }
-
-    int size() const {
-        return static_cast<int>(to_tuple.size());
-    }
+/// Replace the initial state q0 by the limit of the vectors reached
+/// from it by reading the all-zero letter ze, in order to account for
+/// the leading zeros of the projected variables.
+inline void absorb_leading_zeros(mutable_automaton<context_t>& A, state_t q0, int ze) {
+    std::map<state_t, value_t> cur, nxt;
+    nxt[q0] = 1;
 
-    std::set<int> labels_set() const {
-        std::set<int> res;
-        for (int i = 0; i < size(); ++i)
-            res.insert(i);
-        return res;
-    }
-
-    std::vector<int> labels() const {
-        std::vector<int> res(size());
-        std::iota(res.begin(), res.end(), 0);
-        std::sort(res.begin(), res.end(), [&](int a, int b) {
-            return to_tuple[a] < to_tuple[b];
-        });
-        return res;
-    }
-};
-
-inline void dfa_from_walnut(
-    const std::string& filename,
-    std::vector<std::map<std::vector<int>, int>>& trans,
-    std::vector<int>& out,
-    LabelMapper& label_mapper
-) {
-    std::ifstream in(filename);
-    if (!in)
-        throw std::runtime_error("Cannot open file: " + filename);
-
-    std::string line;
-    std::getline(in, line);
-
-    int current_state = -1;
-    std::map<std::vector<int>, int> current_trans;
-
-    while (std::getline(in, line)) {
-        std::stringstream ss(line);
-        std::string s = line;
-        if (s.empty()) continue;
-
-        auto pos = s.find("->");
-        if (pos == std::string::npos) {
-            if (current_state != -1)
-                trans[current_state] = current_trans;
-            current_trans.clear();
-
-            std::stringstream st_line(s);
-            int q, o;
-            st_line >> q >> o;
-            current_state = q;
-            if (q >= (int)out.size())
-                out.resize(q + 1);
-            out[q] = o;
-            if (q >= (int)trans.size())
-                trans.resize(q + 1);
-        } else {
-            std::string left = s.substr(0, pos);
-            std::string right = s.substr(pos + 2);
-            std::stringstream left_ss(left);
-            std::vector<int> label;
-            int val;
-            while (left_ss >> val)
-                label.push_back(val);
-            int target = std::stoi(right);
-            current_trans[label] = target;
-            label_mapper.get(label);
+    while (cur != nxt) {
+        cur = nxt;
+        nxt.clear();
+        for (const auto& [q, w] : cur) {
+            for (const auto& tr : A->all_out(q))
+                if (A->label_of(tr) == ze)
+                    nxt[A->dst_of(tr)] += w * A->weight_of(tr);
         }
     }
 
-    if (current_state != -1)
-        trans[current_state] = current_trans;
+    for (const auto& [q, w] : cur)
+        A->set_initial(q, w);
 }
 
 inline std::pair<mutable_automaton<context_t>, LabelMapper>
@@ -146,7 +70,8 @@ dfa_count(
     const std::vector<int>& vars,
 std::function<std::vector<int>(const std::vector<int>&)> remap = [](const std::vector<int>& x) {
     return x;
-}
+},
+    exec_context& ctx = exec_context::global()
 ) {
 
     LabelMapper proj_map;
@@ -160,8 +85,8 @@ std::function<std::vector<int>(const std::vector<int>&)> remap = [](const std::v
 
     labelset_t alphabet = labelset_t(proj_map.labels_set());
     weightset_t weights;
-    context_t ctx(alphabet, weights);
-    auto A = make_mutable_automaton(ctx);
+    context_t c(alphabet, weights);
+    auto A = make_mutable_automaton(c);
 
     std::vector<state_t> states(out.size());
     for (size_t i = 0; i < out.size(); ++i)
@@ -172,6 +97,7 @@ std::function<std::vector<int>(const std::vector<int>&)> remap = [](const std::v
             A->set_final(states[i],value_t(out[i]));
 
     for (size_t q = 0; q < trans.size(); ++q) {
+        ctx.check();
         for (const auto& [t, qq] : trans[q]) {
             std::vector<int> proj;
             for (int i : vars)
@@ -182,26 +108,374 @@ std::function<std::vector<int>(const std::vector<int>&)> remap = [](const std::v
     }
 
     int ze = proj_map.get(std::vector<int>(vars.size(), 0));
+    absorb_leading_zeros(A, states[0], ze);
 
-    std::map<state_t, int> cur, nxt;
-    nxt[states[0]] = 1;
+    return { A, proj_map };
+}
 
-    while (cur != nxt) {
-        cur = nxt;
-        nxt.clear();
-        for (const auto& [q, w] : cur) {
-            for (const auto& tr : A->all_out(q))
-                if (A->label_of(tr) == ze)
-                    nxt[A->dst_of(tr)] += w * A->weight_of(tr).get_num().get_si();
+inline std::string pretty(const std::vector<int>& v) {
+    std::ostringstream oss;
+    for (size_t i = 0; i < v.size(); ++i) {
+        if (i > 0) oss << " ";
+        oss << v[i];
+    }
+    return oss.str();
+}
+
+/// The numbers of a Maple list or list of lists, row by row.
+inline std::vector<std::vector<value_t>> mpl_rows(const std::string& s) {
+    std::vector<std::vector<value_t>> rows;
+    std::string tok;
+    auto flush = [&]() {
+        if (!tok.empty()) {
+            if (rows.empty())
+                throw std::runtime_error("mpl: number outside of a list: " + tok);
+            value_t x(tok);
+            x.canonicalize();
+            rows.back().push_back(x);
+            tok.clear();
+        }
+    };
+    for (char c : s) {
+        if (c == '[') {
+            flush();
+            rows.emplace_back();
+        } else if (c == ']' || c == ',') {
+            flush();
+        } else if (std::isdigit(static_cast<unsigned char>(c)) || c == '-' || c == '/') {
+            tok += c;
         }
     }
+    flush();
+    rows.erase(std::remove_if(rows.begin(), rows.end(),
+                              [](const auto& r) { return r.empty(); }),
+               rows.end());
+    return rows;
+}
 
-    for (const auto& [q, w] : cur)
-        A->set_initial(q, value_t(w));
+/*
+  Linear representation written by Walnut's eval in the .mpl files of
+  Result/: the row vector v, one matrix M_x_..._d_... for each tuple d
+  of digits of the free variables x, the column vector w and the loop
+  that fixes up v for the leading zeros (v := v.M_x_0 as many times as
+  the dimension), which is applied here.  The digits are the labels,
+  and the names of the variables are stored in vars if given.
+*/
+inline std::pair<mutable_automaton<context_t>, LabelMapper>
+mpl_from_walnut(const std::string& filename, std::vector<std::string>* vars = nullptr) {
+    std::ifstream in(filename);
+    if (!in)
+        throw std::runtime_error("Cannot open file: " + filename);
+
+    std::string text, line;
+    while (std::getline(in, line))
+        text += line.substr(0, line.find('#')) + "\n";
+
+    std::vector<value_t> v, w;
+    std::map<std::vector<int>, std::vector<std::vector<value_t>>> mats;
+    std::vector<int> fixup;
+    bool has_fixup = false;
+
+    auto trim = [](const std::string& s) {
+        auto b = s.find_first_not_of(" \t\n");
+        auto e = s.find_last_not_of(" \t\n");
+        return b == std::string::npos ? std::string() : s.substr(b, e - b + 1);
+    };
+    // M_n_0 or M_i_n_0_1: the names of the variables, then the digits.
+    std::vector<std::string> names;
+    auto digits_of_name = [&names](const std::string& name) {
+        std::vector<int> t;
+        names.clear();
+        std::stringstream ss(name.substr(2));
+        std::string part;
+        while (std::getline(ss, part, '_'))
+            if (!part.empty() && (std::isdigit(static_cast<unsigned char>(part[0])) || part[0] == '-'))
+                t.push_back(std::stoi(part));
+            else
+                names.push_back(part);
+        return t;
+    };
+
+    std::stringstream stmts(text);
+    std::string stmt;
+    while (std::getline(stmts, stmt, ';')) {
+        auto pos = stmt.find(":=");
+        if (pos == std::string::npos)
+            continue;
+        // the last word before := (the statements are not split on ':')
+        std::string lhs = trim(stmt.substr(0, pos));
+        lhs = lhs.substr(lhs.find_last_of(" \t\n") + 1);
+        std::string rhs = trim(stmt.substr(pos + 2));
+        if (rhs.rfind("Vector", 0) == 0) {
+            auto rows = mpl_rows(rhs.substr(rhs.find('(')));
+            auto& dst = lhs == "w" ? w : v;
+            dst = rows.empty() ? std::vector<value_t>() : rows[0];
+        } else if (rhs.rfind("Matrix", 0) == 0) {
+            mats[digits_of_name(lhs)] = mpl_rows(rhs.substr(rhs.find('(')));
+        } else if (rhs.rfind("v.M_", 0) == 0) {
+            fixup = digits_of_name(trim(rhs.substr(2)));
+            has_fixup = true;
+        }
+    }
+
+    size_t n = v.size();
+    if (n == 0 || w.size() != n || mats.empty())
+        throw std::runtime_error("mpl: no linear representation in " + filename);
+    for (const auto& [d, m] : mats)
+        if (m.size() != n || std::any_of(m.begin(), m.end(),
+                                         [n](const auto& r) { return r.size() != n; }))
+            throw std::runtime_error("mpl: matrix " + pretty(d) + " is not " + std::to_string(n)
+                                     + "x" + std::to_string(n) + " in " + filename);
+
+    if (has_fixup) {
+        auto it = mats.find(fixup);
+        if (it == mats.end())
+            throw std::runtime_error("mpl: unknown matrix " + pretty(fixup) + " in " + filename);
+        for (size_t r = 0; r < n; ++r) {
+            std::vector<value_t> nv(n);
+            for (size_t i = 0; i < n; ++i)
+                if (v[i] != 0)
+                    for (size_t j = 0; j < n; ++j)
+                        if (it->second[i][j] != 0)
+                            nv[j] += v[i] * it->second[i][j];
+            v.swap(nv);
+        }
+    }
+
+    LabelMapper al;
+    for (const auto& [d, m] : mats)
+        al.get(d);
+    if (vars)
+        *vars = names;
+
+    auto A = make_mutable_automaton(context_t(labelset_t(al.labels_set()), weightset_t()));
+    std::vector<state_t> states(n);
+    for (size_t i = 0; i < n; ++i)
+        states[i] = A->add_state();
+    for (size_t i = 0; i < n; ++i) {
+        if (v[i] != 0)
+            A->set_initial(states[i], v[i]);
+        if (w[i] != 0)
+            A->set_final(states[i], w[i]);
+    }
+    for (const auto& [d, m] : mats) {
+        int label = al.get(d);
+        for (size_t i = 0; i < n; ++i)
+            for (size_t j = 0; j < n; ++j)
+                if (m[i][j] != 0)
+                    A->add_transition(states[i], states[j], label, m[i][j]);
+    }
+
+    return { A, al };
+}
+
+/*
+  Native construction of the counting automaton of occ_foo (see
+  input/gen_occ.txt) from feq_foo(i,j,n) and the addition automaton
+  msd_foo_addition(x,y,z) of the numeration system: it computes, for
+  every (i,j1,k,n), the number of u such that j1<=u<=j1+n and
+  feq_foo(i,u,k).  u and m=j1+n are hidden tracks: the states are the
+  tuples (feq state, addition state, j1 vs u, u vs m) and the
+  transitions are projected on (i,j1,k,n) and counted, as dfa_count
+  does with the DFA produced by Walnut.
+*/
+enum { CMP_EQ = 0, CMP_LT = 1, CMP_GT = 2 };
+
+inline int cmp_step(int c, int x, int y) {
+    if (c != CMP_EQ)
+        return c;
+    return x < y ? CMP_LT : (x > y ? CMP_GT : CMP_EQ);
+}
+
+/// All the tuples of the given size over digits, in lexicographic order.
+inline void all_tuples(LabelMapper& al, const std::vector<int>& digits, size_t size) {
+    std::vector<int> t(size, digits[0]);
+    std::vector<size_t> pos(size, 0);
+    while (true) {
+        al.get(t);
+        size_t i = size;
+        while (i > 0 && pos[i - 1] + 1 == digits.size()) {
+            pos[i - 1] = 0;
+            t[i - 1] = digits[0];
+            --i;
+        }
+        if (i == 0)
+            return;
+        t[i - 1] = digits[++pos[i - 1]];
+    }
+}
+
+inline std::pair<mutable_automaton<context_t>, LabelMapper>
+occ_count(
+    const std::vector<std::map<std::vector<int>, int>>& feq,
+    const std::vector<int>& feq_out,
+    const std::vector<std::map<std::vector<int>, int>>& add,
+    const std::vector<int>& add_out,
+    const std::vector<int>& digits,
+    exec_context& ctx = exec_context::global()
+) {
+    LabelMapper proj_map;
+    all_tuples(proj_map, digits, 4);
+
+    labelset_t alphabet = labelset_t(proj_map.labels_set());
+    weightset_t weights;
+    context_t c(alphabet, weights);
+    auto A = make_mutable_automaton(c);
+
+    using key_t = std::array<int, 4>;
+    std::map<key_t, state_t> states;
+    std::deque<key_t> todo;
+
+    auto get = [&](const key_t& k) {
+        auto it = states.find(k);
+        if (it != states.end())
+            return it->second;
+        state_t q = A->add_state();
+        states.emplace(k, q);
+        todo.push_back(k);
+        if (feq_out[k[0]] > 0 && add_out[k[1]] > 0)
+            A->set_final(q, value_t(1));
+        return q;
+    };
+
+    state_t q0 = get({0, 0, CMP_EQ, CMP_EQ});
+    while (!todo.empty()) {
+        ctx.check();
+        key_t k = todo.front();
+        todo.pop_front();
+        state_t q = states[k];
+        if ((size_t)k[0] >= feq.size() || (size_t)k[1] >= add.size())
+            continue;
+        // feq reads (i,u,k) and the addition reads (j1,n,m)
+        for (const auto& [f, ff] : feq[k[0]])
+            for (const auto& [a, aa] : add[k[1]]) {
+                int c1 = cmp_step(k[2], a[0], f[1]);
+                int c2 = cmp_step(k[3], f[1], a[2]);
+                if (c1 == CMP_GT || c2 == CMP_GT)
+                    continue;
+                int label = proj_map.get({f[0], a[0], f[2], a[1]});
+                A->add_transition(q, get({ff, aa, c1, c2}), label, value_t(1));
+            }
+    }
+
+    int ze = proj_map.get(std::vector<int>(4, digits[0]));
+    absorb_leading_zeros(A, q0, ze);
 
     return { A, proj_map };
 }
 
+/// Insert a new track at position pos whose values are restricted to
+/// the words accepted by the DFA valid (the numeration system): the
+/// result computes A on the other tracks when the new one is valid
+/// and 0 otherwise.
+inline mutable_automaton<context_t> insert_track(
+    const mutable_automaton<context_t>& A,
+    const LabelMapper& al,
+    LabelMapper& nl,
+    size_t pos,
+    const std::vector<std::map<std::vector<int>, int>>& valid,
+    const std::vector<int>& valid_out,
+    exec_context& ctx = exec_context::global()
+) {
+    auto B = make_mutable_automaton(context_t(labelset_t(nl.labels_set()), weightset_t()));
+    std::map<std::pair<state_t, int>, state_t> states;
+    std::deque<std::pair<state_t, int>> todo;
+
+    auto get = [&](state_t q, int v) {
+        auto it = states.find({q, v});
+        if (it != states.end())
+            return it->second;
+        state_t p = B->add_state();
+        states.emplace(std::make_pair(q, v), p);
+        todo.push_back({q, v});
+        value_t w = A->get_final_weight(q);
+        if (valid_out[v] > 0 && w != 0)
+            B->set_final(p, w);
+        return p;
+    };
+
+    for (auto t : A->initial_transitions())
+        B->set_initial(get(A->dst_of(t), 0), A->weight_of(t));
+
+    while (!todo.empty()) {
+        ctx.check();
+        auto [q, v] = todo.front();
+        todo.pop_front();
+        state_t p = states[{q, v}];
+        if ((size_t)v >= valid.size())
+            continue;
+        for (auto tr : A->out(q))
+            for (const auto& [d, vv] : valid[v]) {
+                std::vector<int> t = al[A->label_of(tr)];
+                t.insert(t.begin() + pos, d[0]);
+                B->add_transition(p, get(A->dst_of(tr), vv), nl.get(t), A->weight_of(tr));
+            }
+    }
+
+    return B;
+}
+
+/// The semigroup trick: the states of the result are the distinct non
+/// zero vectors reached from the initial vector of A, in breadth-first
+/// order, with the final weight of the vector; the exploration is
+/// bounded by the budgets of ctx (ABCOMP_MAX_STATES in particular).
+template<typename Aut>
+Aut explore_vectors(const Aut& A, exec_context& ctx = exec_context::global()) {
+    using weight_t = typename context_t_of<Aut>::weight_t;
+    using label_t = label_t_of<Aut>;
+    using vec_t = std::map<state_t, weight_t>;
+    const auto& ws = *A->weightset();
+
+    auto B = make_mutable_automaton(A->context());
+    std::map<vec_t, state_t> states;
+    std::deque<const vec_t*> todo;
+
+    auto get = [&](vec_t&& v) {
+        auto it = states.find(v);
+        if (it != states.end())
+            return it->second;
+        state_t p = B->add_state();
+        it = states.emplace(std::move(v), p).first;
+        todo.push_back(&it->first);
+        ctx.check_states(states.size());
+        weight_t f = ws.zero();
+        for (const auto& [q, w] : it->first)
+            f = ws.add(f, ws.mul(w, A->get_final_weight(q)));
+        if (!ws.is_zero(f))
+            B->set_final(p, f);
+        return p;
+    };
+
+    vec_t init;
+    for (auto t : A->initial_transitions())
+        init[A->dst_of(t)] = ws.add(init[A->dst_of(t)], A->weight_of(t));
+    for (auto it = init.begin(); it != init.end();)
+        it = ws.is_zero(it->second) ? init.erase(it) : std::next(it);
+    if (init.empty())
+        return B;
+    B->set_initial(get(std::move(init)), ws.one());
+
+    while (!todo.empty()) {
+        const vec_t& v = *todo.front();
+        todo.pop_front();
+        state_t p = states.at(v);
+        std::map<label_t, vec_t> next;
+        for (const auto& [q, w] : v)
+            for (auto tr : A->out(q)) {
+                auto& x = next[A->label_of(tr)][A->dst_of(tr)];
+                x = ws.add(x, ws.mul(w, A->weight_of(tr)));
+            }
+        for (auto& [a, nv] : next) {
+            for (auto it = nv.begin(); it != nv.end();)
+                it = ws.is_zero(it->second) ? nv.erase(it) : std::next(it);
+            if (!nv.empty())
+                B->new_transition(p, get(std::move(nv)), a, ws.one());
+        }
+    }
+
+    return B;
+}
+
 mutable_automaton<context_t> remap_labels(
     const mutable_automaton<context_t>& A,
     dfa::LabelMapper& al,
@@ -234,6 +508,20 @@ mutable_automaton<context_t> remap_labels(
     return B;
 }
 
+/// remap_labels without the copy: a view of A whose labels are
+/// mapped once for all the labels of al (the new ones are added to al
+/// here, so that the view only reads the map).
+inline auto remap_view(
+    const mutable_automaton<context_t>& A,
+    dfa::LabelMapper& al,
+    const std::function<std::vector<int>(const std::vector<int>&)>& reorder
+) {
+    std::vector<int> label_map(al.size());
+    for (int a = 0; a < static_cast<int>(label_map.size()); ++a)
+        label_map[a] = al.get(reorder(al[a]));
+    return relabel_view(A, [label_map](int a) { return label_map[a]; });
+}
+
 void opposite_here(mutable_automaton<context_t>& A) {
     for (auto itA : A->initial_transitions()) {
         auto w = A->weight_of(itA);
@@ -242,15 +530,6 @@ void opposite_here(mutable_automaton<context_t>& A) {
     }
 }
 
-inline std::string pretty(const std::vector<int>& v) {
-    std::ostringstream oss;
-    for (size_t i = 0; i < v.size(); ++i) {
-        if (i > 0) oss << " ";
-        oss << v[i];
-    }
-    return oss.str();
-}
-
 template<typename T>
 void to_walnut(
     const mutable_automaton<T>& A,
@@ -398,107 +677,259 @@ void show_matrix(const Aut& A, const dfa::LabelMapper& al, std::ostream& out, bo
     std::cout << "max: " << damax << std::endl;
 }
 
-template<typename Automaton>
-Automaton prefix_absorb(const Automaton& input, const std::vector<label_t_of<Automaton>>& u) {
-    using automaton_t = Automaton;
-    using context_t = context_t_of<automaton_t>;
-    using weightset_t = typename context_t::weightset_t;
-    using weight_t = typename context_t::weight_t;
-    using label_t = label_t_of<automaton_t>;
-    using state_t = typename automaton_t::element_type::state_t;
+/// Linear representation of A in the format of Walnut's eval (see
+/// dfa::mpl_from_walnut), with one matrix for each label of al and
+/// vars as the names of the tracks.  The initial vector is written as
+/// is: there is no loop for the leading zeros.
+template<typename Aut>
+void to_mpl(const Aut& A, const dfa::LabelMapper& al, std::ostream& out,
+            const std::vector<std::string>& vars)
+{
+    using weight_t = typename context_t_of<Aut>::weight_t;
 
-    using namespace std;
-    using namespace awali::sttc;
+    std::unordered_map<state_t, unsigned> state_to_index;
+    unsigned n = 0;
+    for (auto s: A->states())
+        state_to_index[s] = n++;
 
-    auto A = copy(input, false, false, false);
+    std::vector<weight_t> init(n), final(n);
+    for (auto t : A->initial_transitions())
+        init[state_to_index[A->dst_of(t)]] = A->weight_of(t);
+    for (auto t : A->final_transitions())
+        final[state_to_index[A->src_of(t)]] = A->weight_of(t);
+
+    auto row = [&](const std::vector<weight_t>& v) {
+        for (unsigned i = 0; i < n; ++i)
+            out << (i ? "," : "") << v[i];
+    };
+
+    out << "with(ArrayTools):" << std::endl;
+    out << "v := Vector[row]([";
+    row(init);
+    out << "]);" << std::endl << std::endl;
+
+    for (int label : al.labels()) {
+        std::vector<std::vector<weight_t>> m(n, std::vector<weight_t>(n));
+        for (auto s : A->states())
+            for (auto t : A->out(s, label))
+                m[state_to_index[s]][state_to_index[A->dst_of(t)]] = A->weight_of(t);
+        out << "M";
+        for (const auto& x : vars)
+            out << "_" << x;
+        for (int d : al[label])
+            out << "_" << d;
+        out << " := Matrix([";
+        for (unsigned i = 0; i < n; ++i) {
+            out << (i ? ",\n[" : "[");
+            row(m[i]);
+            out << "]";
+        }
+        out << "]);" << std::endl << std::endl;
+    }
 
-    map<state_t, weight_t> cur, nxt;
+    out << "w := Vector[column]([";
+    row(final);
+    out << "]);" << std::endl;
+}
 
-    for (auto t : A->initial_transitions()) {
-        cur[A->dst_of(t)] += A->weight_of(t);
+/// Write the matrices of A with to_mpl if filename ends with .mpl, with
+/// show_matrix otherwise.
+template<typename Aut>
+void write_matrices(const Aut& A, const dfa::LabelMapper& al, const std::string& filename,
+                    const std::vector<std::string>& vars, bool check_int = false)
+{
+    std::ofstream out(filename);
+    if (!out)
+        throw std::runtime_error("Cannot open file: " + filename);
+    if (filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".mpl") == 0)
+        to_mpl(A, al, out, vars);
+    else
+        show_matrix(A, al, out, check_int);
+}
+
+/// The last complete intermediate result of a tool, written with to_mpl
+/// if the tool is stopped.
+class checkpoint
+{
+public:
+    explicit checkpoint(std::string filename)
+        : filename_(std::move(filename))
+    {}
+
+    template<typename Aut>
+    void set(const Aut& A, const dfa::LabelMapper& al, const std::vector<std::string>& vars)
+    {
+        write_ = [A, al, vars](std::ostream& out) { to_mpl(A, al, out, vars); };
     }
 
-    for (label_t a : u) {
-        nxt.clear();
-        for (const auto& [q, w] : cur) {
-            for (auto tr : A->all_out(q)) {
-                if (A->label_of(tr) == a) {
-                    state_t dst = A->dst_of(tr);
-                    weight_t wt = A->weight_of(tr);
-                    nxt[dst] += w * wt;
-                }
+    void save() const
+    {
+        if (!write_)
+            return;
+        std::ofstream out(filename_);
+        write_(out);
+        std::cerr << "checkpoint written to " << filename_ << std::endl;
+    }
+
+private:
+    std::string filename_;
+    std::function<void(std::ostream&)> write_;
+};
+
+/// run_tool (context.hh) saving the checkpoint on a stop.
+inline int run_tool(const checkpoint& ck, const std::function<int()>& body)
+{
+    return awali::sttc::run_tool(body, [&ck]() { ck.save(); });
+}
+
+/*
+  Initial vectors of input after reading each of the prefixes:
+  res[k][i] is the weight of the i-th state of input->states() after
+  reading prefixes[k].  The prefixes are walked in lexicographic
+  order, as the paths of their trie: the vector of the longest common
+  prefix with the previous one is kept on a stack and only the rest of
+  the prefix is read, with dense vectors and the matrices of the
+  letters in compressed sparse rows.  The automaton is not copied.
+*/
+template<typename Automaton>
+std::vector<std::vector<weight_t_of<Automaton>>>
+prefix_absorb_all(const Automaton& input,
+                  const std::vector<std::vector<label_t_of<Automaton>>>& prefixes)
+{
+    using weight_t = weight_t_of<Automaton>;
+    using label_t = label_t_of<Automaton>;
+    using vector_t = std::vector<weight_t>;
+    const auto& ws = *input->weightset();
+
+    std::unordered_map<state_t, unsigned> index;
+    for (auto q : input->states())
+        index.emplace(q, index.size());
+    unsigned n = index.size();
+    // For each letter, the rows start[i] .. start[i+1] of (column, weight).
+    struct csr
+    {
+        std::vector<unsigned> start;
+        std::vector<std::pair<unsigned, weight_t>> entries;
+    };
+    std::map<label_t, csr> mu;
+    {
+        std::map<label_t, std::vector<std::vector<std::pair<unsigned, weight_t>>>> rows;
+        for (auto t : input->transitions())
+        {
+            auto& r = rows[input->label_of(t)];
+            r.resize(n);
+            r[index.at(input->src_of(t))].emplace_back(index.at(input->dst_of(t)),
+                                                       input->weight_of(t));
+        }
+        for (auto& lr : rows)
+        {
+            csr& m = mu[lr.first];
+            m.start.push_back(0);
+            for (auto& row : lr.second)
+            {
+                m.entries.insert(m.entries.end(), row.begin(), row.end());
+                m.start.push_back(m.entries.size());
             }
         }
-        cur = nxt;
     }
 
-    for (auto q : A->states()) {
-        A->set_initial(q, weightset_t::zero());
+    std::vector<vector_t> path(1, vector_t(n, ws.zero()));
+    for (auto t : input->initial_transitions())
+        path[0][index.at(input->dst_of(t))] += input->weight_of(t);
+    std::vector<unsigned> order(prefixes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&](unsigned x, unsigned y) { return prefixes[x] < prefixes[y]; });
+    std::vector<vector_t> res(prefixes.size());
+    const std::vector<label_t>* last = nullptr;
+    for (unsigned k : order)
+    {
+        const auto& u = prefixes[k];
+        // depth of the common prefix with the last walked one
+        size_t d = 0;
+        if (last != nullptr)
+            while (d < u.size() && d < last->size() && u[d] == (*last)[d])
+                ++d;
+        path.resize(d + 1);
+        for (; d < u.size(); ++d)
+        {
+            vector_t next(n, ws.zero());
+            auto it = mu.find(u[d]);
+            if (it != mu.end())
+            {
+                const csr& m = it->second;
+                const vector_t& cur = path[d];
+                for (unsigned i = 0; i < n; ++i)
+                    if (!ws.is_zero(cur[i]))
+                        for (unsigned e = m.start[i]; e < m.start[i + 1]; ++e)
+                            next[m.entries[e].first] += cur[i] * m.entries[e].second;
+            }
+            path.push_back(std::move(next));
+        }
+        res[k] = path.back();
+        last = &u;
     }
+    return res;
+}
 
-    for (const auto& [q, w] : cur) {
-        A->set_initial(q, w);
+/// The automaton with the initial vector after reading u.
+template<typename Automaton>
+Automaton prefix_absorb(const Automaton& input, const std::vector<label_t_of<Automaton>>& u) {
+    auto A = copy(input, false, false, false);
+    auto init = prefix_absorb_all(A, {u})[0];
+    unsigned i = 0;
+    for (auto q : A->states()) {
+        A->set_initial(q, init[i++]);
     }
-
     return A;
 }
 
+/// The z-broadcast of s in place: the outgoing transitions of each
+/// state become the ones of broadcast_view (views.hh).  Only out() is
+/// read and rewritten, so the initial and final weights are kept.
 template<typename Automaton>
 void modify_transitions(Automaton& s, label_t_of<Automaton> z) {
-    using state_t = typename Automaton::element_type::state_t;
-    using weight_t = typename Automaton::element_type::weight_t;
+    using label_t = label_t_of<Automaton>;
+    using weight_t = weight_t_of<Automaton>;
 
+    auto b = broadcast_view(s, z);
     for (auto q : s->states()) {
-        std::vector<std::pair<state_t, weight_t>> qtrans;
-        std::set<label_t_of<Automaton>> qlab;
-
-        for (auto tr : s->all_out(q)) {
-            if (s->label_of(tr) == z) {
-                state_t dst = s->dst_of(tr);
-                weight_t wt = s->weight_of(tr);
-                qtrans.push_back({dst, wt});
-            }
-            else {
-                s->set_weight_of(tr, weight_t::zero());
-                qlab.insert(s->label_of(tr));
-            }
-        }
-
-        qlab.insert(z);
-
-        for (auto a : qlab) {
-            for (auto [q_prime, w] : qtrans) {
-                s->add_transition(q, q_prime, a, w);
-            }
-        }
+        // the view reads the transitions of q: they are copied before
+        // they are deleted
+        std::vector<std::tuple<state_t, label_t, weight_t>> qtrans;
+        for (const auto& tr : b->out(q))
+            qtrans.emplace_back(b->dst_of(tr), b->label_of(tr), b->weight_of(tr));
+        std::vector<transition_t> old;
+        for (auto tr : s->out(q))
+            old.push_back(tr);
+        for (auto tr : old)
+            s->del_transition(tr);
+        for (const auto& [q_prime, a, w] : qtrans)
+            s->add_transition(q, q_prime, a, w);
     }
 }
 
+/// The sum of s and of the reduced opposite of its z-broadcast
+/// (modify_transitions), as a view: neither the broadcast nor the sum
+/// is built.
 template<typename Automaton>
-Automaton gview(Automaton& s, label_t_of<Automaton> z) {
-    Automaton s2 = s.copy();
-    modify_transitions(s2, z);
-    opposite_here(s2);
-    auto s1 = s;
-    auto s2_reduced = reduce(s2);
-    auto result = sum(s1, s2_reduced);
-    return result;
+auto gview(const Automaton& s, label_t_of<Automaton> z) {
+    auto s2 = reduce_view<Automaton>(opposite_view(broadcast_view(s, z)));
+    return sum_view(s, s2);
 }
 
 template<typename Automaton, typename label_t>
-Automaton fromthere(Automaton& s, label_t_of<Automaton> zero, 
-                 std::vector<label_t> u, Automaton& sup, int n) {
+Automaton fromthere(const Automaton& s, label_t_of<Automaton> zero,
+                    std::vector<label_t> u, const Automaton& sup, int n) {
     auto su = prefix_absorb(s, u);
     auto cur = gview(su, zero);
-    
+
     if (sup == nullptr) {
-        return reduce(cur);
+        return reduce_view<Automaton>(cur);
     }
-    
-    auto curs = prefix_absorb(*sup, u);
-    auto res = join_automata(&cur, &curs);
-    res.product();
-    return reduce(res);
+
+    auto curs = prefix_absorb(sup, u);
+    return reduce(product(reduce_view<Automaton>(cur), curs));
 }
 
 #endif // WALNUT_HH
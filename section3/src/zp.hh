@@ -0,0 +1,420 @@
+#ifndef AWALI_WEIGHTSET_ZP_HH
+#define AWALI_WEIGHTSET_ZP_HH
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <gmpxx.h>
+#include <awali/sttc/weightset/z.hh>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ZP_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace awali {
+namespace sttc {
+
+/*
+  The field Z/pZ for the prime p = 2^31-19, used to compute ranks
+  (hence the dimension of a reduction) much faster than over Q.
+
+  A product a.x where a is fixed (the ratio of an elimination, the
+  inverse of a pivot, the weight of a row) uses the precomputed
+  quotient a' = floor(a.2^32/p) (Shoup's variant of Barrett's
+  reduction): with q = (a'.x) >> 32, a.x - q.p lies in [0,2p[ and is
+  computed modulo 2^32.  The loops on contiguous vectors (axpy, scale,
+  dot) have AVX-512 and AVX2 versions chosen at runtime, and a scalar
+  one.
+*/
+class zp {
+public:
+    using value_t = uint32_t;
+    using self_type = zp;
+
+    static constexpr uint32_t P = 2147483629u;
+
+    static std::string sname() {
+        return "zp";
+    }
+
+    std::string vname(bool = true) const {
+        return sname();
+    }
+
+    static value_t zero() {
+        return 0;
+    }
+
+    static value_t one() {
+        return 1;
+    }
+
+    static value_t add(value_t l, value_t r) {
+        uint32_t s = l + r;
+        return s >= P ? s - P : s;
+    }
+
+    static value_t sub(value_t l, value_t r) {
+        return l >= r ? l - r : l + (P - r);
+    }
+
+    static value_t mul(value_t l, value_t r) {
+        return (uint64_t) l * r % P;
+    }
+
+    static value_t inverse(value_t v) {
+        if (v == 0) throw std::domain_error("zp: division by zero");
+        // Fermat: v^(p-2)
+        uint64_t r = 1, b = v;
+        for (uint32_t e = P - 2; e; e >>= 1) {
+            if (e & 1)
+                r = r * b % P;
+            b = b * b % P;
+        }
+        return r;
+    }
+
+    static value_t rdiv(value_t l, value_t r) {
+        return mul(l, inverse(r));
+    }
+
+    static value_t ldiv(value_t l, value_t r) {
+        return rdiv(r, l);
+    }
+
+    value_t star(value_t v) const {
+        if (v == 1) throw std::domain_error("zp: star invalid value (v = 1)");
+        return inverse(sub(1, v));
+    }
+
+    value_t plus(value_t v) const {
+        return mul(v, star(v));
+    }
+
+    static bool is_zero(value_t v) {
+        return v == 0;
+    }
+
+    static bool is_one(value_t v) {
+        return v == 1;
+    }
+
+    static bool equals(value_t l, value_t r) {
+        return l == r;
+    }
+
+    static bool less_than(value_t l, value_t r) {
+        return l < r;
+    }
+
+    static value_t abs(value_t v) {
+        return v;
+    }
+
+    static value_t transpose(value_t v) {
+        return v;
+    }
+
+    static value_t
+    conv(self_type, value_t v)
+    {
+        return v;
+    }
+
+    static value_t
+    conv(z, z::value_t v)
+    {
+        int64_t r = (int64_t) v % (int64_t) P;
+        return r < 0 ? r + P : r;
+    }
+
+    static value_t
+    conv(b, b::value_t v)
+    {
+        return v ? 1 : 0;
+    }
+
+    /// Image of a rational number; throws if p divides the denominator.
+    static value_t conv(const mpq_class& v) {
+        uint32_t n = mpz_fdiv_ui(v.get_num_mpz_t(), P);
+        uint32_t d = mpz_fdiv_ui(v.get_den_mpz_t(), P);
+        return rdiv(n, d);
+    }
+
+    static value_t conv(std::istream& is) {
+        int64_t v;
+        is >> v;
+        if (!is) throw std::runtime_error("zp: invalid input");
+        return conv(z(), v);
+    }
+
+    static std::ostream& print(value_t v, std::ostream& o,
+                               const std::string& = "text") {
+        return o << v;
+    }
+
+    std::ostream& print_set(std::ostream& o, const std::string& format = "text") const {
+        if (format == "latex")
+            o << "\\mathbb{Z}/" << P << "\\mathbb{Z}";
+        else if (format == "text")
+            o << "Z/" << P << "Z";
+        else
+            throw std::runtime_error("zp: invalid format: " + format);
+        return o;
+    }
+
+    static value_t conv(int v) {
+        return conv(z(), v);
+    }
+
+    static value_t conv(bool v) {
+        return v ? 1 : 0;
+    }
+
+    /// Precomputed quotient of a for mul_fixed.
+    static uint32_t shoup(value_t a) {
+        return ((uint64_t) a << 32) / P;
+    }
+
+    /// a.x where ap = shoup(a).
+    static value_t mul_fixed(value_t x, value_t a, uint32_t ap) {
+        uint32_t q = ((uint64_t) x * ap) >> 32;
+        uint32_t r = a * x - q * P;
+        return r >= P ? r - P : r;
+    }
+
+    /// y := y - a.x on n entries
+    static void axpy(value_t* y, const value_t* x, size_t n, value_t a);
+    /// x := a.x on n entries
+    static void scale(value_t* x, size_t n, value_t a);
+    /// sum of x[i].y[i] on n entries
+    static value_t dot(const value_t* x, const value_t* y, size_t n);
+};
+
+inline zp join(const zp&, const zp&) {
+    return {};
+}
+
+namespace zp_kernel {
+
+using value_t = zp::value_t;
+
+inline void axpy_scalar(value_t* y, const value_t* x, size_t from, size_t n,
+                        value_t a, uint32_t ap)
+{
+    for (size_t i = from; i < n; ++i)
+        y[i] = zp::sub(y[i], zp::mul_fixed(x[i], a, ap));
+}
+
+inline void scale_scalar(value_t* x, size_t from, size_t n,
+                         value_t a, uint32_t ap)
+{
+    for (size_t i = from; i < n; ++i)
+        x[i] = zp::mul_fixed(x[i], a, ap);
+}
+
+/// Products are < 2^62: the 64 bits accumulator is kept below 2^63
+/// by subtracting a multiple of p.
+static constexpr uint64_t FOLD = ((uint64_t) 1 << 63) / zp::P * zp::P;
+
+inline value_t dot_scalar(const value_t* x, const value_t* y, size_t from,
+                          size_t n, uint64_t acc = 0)
+{
+    for (size_t i = from; i < n; ++i) {
+        acc += (uint64_t) x[i] * y[i];
+        if (acc >> 63)
+            acc -= FOLD;
+    }
+    return acc % zp::P;
+}
+
+#ifdef ZP_X86
+
+// q = mulhi(x, ap) on the 8 lanes
+__attribute__((target("avx2")))
+inline __m256i mulhi_avx2(__m256i x, __m256i ap)
+{
+    __m256i lo = _mm256_mul_epu32(x, ap);
+    __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), ap);
+    return _mm256_blend_epi32(_mm256_srli_epi64(lo, 32), hi, 0xAA);
+}
+
+// a.x in [0,p[ from a.x - q.p in [0,2p[
+__attribute__((target("avx2")))
+inline __m256i mul_fixed_avx2(__m256i x, __m256i a, __m256i ap, __m256i p)
+{
+    __m256i q = mulhi_avx2(x, ap);
+    __m256i r = _mm256_sub_epi32(_mm256_mullo_epi32(x, a), _mm256_mullo_epi32(q, p));
+    return _mm256_min_epu32(r, _mm256_sub_epi32(r, p));
+}
+
+__attribute__((target("avx2")))
+inline void axpy_avx2(value_t* y, const value_t* x, size_t n, value_t a, uint32_t ap)
+{
+    __m256i va = _mm256_set1_epi32(a), vap = _mm256_set1_epi32(ap);
+    __m256i vp = _mm256_set1_epi32(zp::P);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i vx = _mm256_loadu_si256((const __m256i*) (x + i));
+        __m256i vy = _mm256_loadu_si256((const __m256i*) (y + i));
+        __m256i d = _mm256_sub_epi32(vy, mul_fixed_avx2(vx, va, vap, vp));
+        d = _mm256_min_epu32(d, _mm256_add_epi32(d, vp));
+        _mm256_storeu_si256((__m256i*) (y + i), d);
+    }
+    axpy_scalar(y, x, i, n, a, ap);
+}
+
+__attribute__((target("avx2")))
+inline void scale_avx2(value_t* x, size_t n, value_t a, uint32_t ap)
+{
+    __m256i va = _mm256_set1_epi32(a), vap = _mm256_set1_epi32(ap);
+    __m256i vp = _mm256_set1_epi32(zp::P);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i vx = _mm256_loadu_si256((const __m256i*) (x + i));
+        _mm256_storeu_si256((__m256i*) (x + i), mul_fixed_avx2(vx, va, vap, vp));
+    }
+    scale_scalar(x, i, n, a, ap);
+}
+
+__attribute__((target("avx2")))
+inline value_t dot_avx2(const value_t* x, const value_t* y, size_t n)
+{
+    __m256i acc = _mm256_setzero_si256();
+    __m256i fold = _mm256_set1_epi64x(FOLD);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i vx = _mm256_loadu_si256((const __m256i*) (x + i));
+        __m256i vy = _mm256_loadu_si256((const __m256i*) (y + i));
+        // even and odd lanes, one after the other to stay below 2^64
+        acc = _mm256_add_epi64(acc, _mm256_mul_epu32(vx, vy));
+        acc = _mm256_sub_epi64(acc, _mm256_and_si256(fold, _mm256_cmpgt_epi64(_mm256_setzero_si256(), acc)));
+        acc = _mm256_add_epi64(acc, _mm256_mul_epu32(_mm256_srli_epi64(vx, 32), _mm256_srli_epi64(vy, 32)));
+        acc = _mm256_sub_epi64(acc, _mm256_and_si256(fold, _mm256_cmpgt_epi64(_mm256_setzero_si256(), acc)));
+    }
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256((__m256i*) lanes, acc);
+    uint64_t r = 0;
+    for (uint64_t l : lanes)
+        r = (r + l % zp::P) % zp::P;
+    return dot_scalar(x, y, i, n, r);
+}
+
+__attribute__((target("avx512f")))
+inline __m512i mul_fixed_avx512(__m512i x, __m512i a, __m512i ap, __m512i p)
+{
+    __m512i lo = _mm512_mul_epu32(x, ap);
+    __m512i hi = _mm512_mul_epu32(_mm512_srli_epi64(x, 32), ap);
+    __m512i q = _mm512_mask_blend_epi32(0xAAAA, _mm512_srli_epi64(lo, 32), hi);
+    __m512i r = _mm512_sub_epi32(_mm512_mullo_epi32(x, a), _mm512_mullo_epi32(q, p));
+    return _mm512_min_epu32(r, _mm512_sub_epi32(r, p));
+}
+
+__attribute__((target("avx512f")))
+inline void axpy_avx512(value_t* y, const value_t* x, size_t n, value_t a, uint32_t ap)
+{
+    __m512i va = _mm512_set1_epi32(a), vap = _mm512_set1_epi32(ap);
+    __m512i vp = _mm512_set1_epi32(zp::P);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i vx = _mm512_loadu_si512(x + i);
+        __m512i vy = _mm512_loadu_si512(y + i);
+        __m512i d = _mm512_sub_epi32(vy, mul_fixed_avx512(vx, va, vap, vp));
+        d = _mm512_min_epu32(d, _mm512_add_epi32(d, vp));
+        _mm512_storeu_si512(y + i, d);
+    }
+    axpy_scalar(y, x, i, n, a, ap);
+}
+
+__attribute__((target("avx512f")))
+inline void scale_avx512(value_t* x, size_t n, value_t a, uint32_t ap)
+{
+    __m512i va = _mm512_set1_epi32(a), vap = _mm512_set1_epi32(ap);
+    __m512i vp = _mm512_set1_epi32(zp::P);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm512_storeu_si512(x + i, mul_fixed_avx512(_mm512_loadu_si512(x + i), va, vap, vp));
+    scale_scalar(x, i, n, a, ap);
+}
+
+#endif
+
+enum class isa { scalar, avx2, avx512 };
+
+/// Best instruction set of the running cpu (ZP_ISA=scalar|avx2|avx512
+/// restricts it).
+inline isa detect()
+{
+#ifdef ZP_X86
+    static const isa best = [] {
+        const char* s = std::getenv("ZP_ISA");
+        std::string want = s ? s : "";
+        __builtin_cpu_init();
+        if (want != "scalar" && want != "avx2" && __builtin_cpu_supports("avx512f"))
+            return isa::avx512;
+        if (want != "scalar" && __builtin_cpu_supports("avx2"))
+            return isa::avx2;
+        return isa::scalar;
+    }();
+    return best;
+#else
+    return isa::scalar;
+#endif
+}
+
+inline const char* to_string(isa i)
+{
+    switch (i) {
+    case isa::avx512: return "avx512";
+    case isa::avx2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+} // namespace zp_kernel
+
+inline void zp::axpy(value_t* y, const value_t* x, size_t n, value_t a)
+{
+    if (a == 0)
+        return;
+    uint32_t ap = shoup(a);
+    switch (zp_kernel::detect()) {
+#ifdef ZP_X86
+    case zp_kernel::isa::avx512: return zp_kernel::axpy_avx512(y, x, n, a, ap);
+    case zp_kernel::isa::avx2: return zp_kernel::axpy_avx2(y, x, n, a, ap);
+#endif
+    default: return zp_kernel::axpy_scalar(y, x, 0, n, a, ap);
+    }
+}
+
+inline void zp::scale(value_t* x, size_t n, value_t a)
+{
+    uint32_t ap = shoup(a);
+    switch (zp_kernel::detect()) {
+#ifdef ZP_X86
+    case zp_kernel::isa::avx512: return zp_kernel::scale_avx512(x, n, a, ap);
+    case zp_kernel::isa::avx2: return zp_kernel::scale_avx2(x, n, a, ap);
+#endif
+    default: return zp_kernel::scale_scalar(x, 0, n, a, ap);
+    }
+}
+
+inline zp::value_t zp::dot(const value_t* x, const value_t* y, size_t n)
+{
+#ifdef ZP_X86
+    if (zp_kernel::detect() != zp_kernel::isa::scalar)
+        return zp_kernel::dot_avx2(x, y, n);
+#endif
+    return zp_kernel::dot_scalar(x, y, 0, n);
+}
+
+
+} // namespace sttc
+} // namespace awali
+
+#endif // AWALI_WEIGHTSET_ZP_HH
@@ -14,6 +14,7 @@ import datetime
 from pathlib import Path as P
 from tempfile import TemporaryDirectory
 from shutil import make_archive
+from hashlib import sha256
 
 today = datetime.date.today().strftime("%Y-%m-%d")
 parser = ArgumentParser(
@@ -57,6 +58,12 @@ parser.add_argument(
     action="store_true",
     help="create zipped Walnut instance instead of notebook",
 )
+parser.add_argument(
+    "-c",
+    "--cache",
+    default=None,
+    help="with -z, store the results of each k in this directory and skip the k already there (overridden by $ABCOMP_CACHE)",
+)
 parser.add_argument(
     "-u", "--unroll", action="store_true", help="unroll Walnut scripts"
 )
@@ -73,6 +80,9 @@ parser.add_argument(
 )
 args = parser.parse_args()
 
+if args.cache is not None and not args.zip:
+    parser.error("--cache requires --zip (notebooks are cached by quarto)")
+
 if args.zip:
     tmpdir = TemporaryDirectory()
     basedir = P(tmpdir.name) / args.name
@@ -204,11 +214,16 @@ waltron(
     f"""def bordercond "?{base} (k<=n => $feq_{name}(i,j,k-1)) & (n<k => $feq_{name}(i,j,n))":"""
 )
 
+if args.cache is not None:
+    walnut_out.close()
+
 for cur in range(args.start, args.end + 1):
     cname = f"{name}b{cur}"
     cbase = f"msd_{cname}"
     cword = cname.title()
     cborder = f"bordercond{cur}"
+    if args.cache is not None:
+        walnut_out = open(walnutdir / "Command Files" / f"gen_abcomp{cur}.txt", "w")
     if cur == 1:
         cbase = base
         cword = word
@@ -275,6 +290,8 @@ def abeq_{name}{cur} "?{base} (n<{cur-1} & $feq_{name}(i,j,n)) | (n>={cur-1} & (
 %SGT comp_{name}{cur} {base} Comp_{name}{cur}
 ```
 """)
+    if args.cache is not None:
+        walnut_out.close()
 
 ### Check it out!
 
@@ -350,17 +367,60 @@ if args.zip:
     goscr = basedir / "go"
     with open(goscr, "w") as f:
         f.write("""#!/bin/sh
-export WALNUT_MEM=64g
+export WALNUT_MEM=${WALNUT_MEM:-64g}
 export WALNUT_HOME=$(pwd)/Walnut
-uv run --python 3.12 --with licofage prelim.py
+""")
+        if args.cache is not None:
+            f.write(f"""ABCOMP_CACHE=${{ABCOMP_CACHE:-{args.cache}}}
+mkdir -p "$ABCOMP_CACHE" || exit 1
+ABCOMP_CACHE=$(cd "$ABCOMP_CACHE" && pwd)
+""")
+        f.write("""uv run --python 3.12 --with licofage prelim.py
 cd $WALNUT_HOME
 echo "load gen_abcomp.txt;" | java -Xmx$WALNUT_MEM -jar $WALNUT_JAR 
 """)
-        for cur in range(args.start, args.end + 1):
-            cname = f"{name}b{cur}"
-            f.write(
-                f"semitrick Result/comp_{name}{cur}.mpl {base} Word\\ Automata\\ Library/Comp_{name}{cur}.txt\n"
-            )
+        if args.cache is None:
+            f.write("semitrick")
+            for cur in range(args.start, args.end + 1):
+                f.write(
+                    f" \\\n  Result/comp_{name}{cur}.mpl {base} Word\\ Automata\\ Library/Comp_{name}{cur}.txt"
+                )
+            f.write("\n")
+        else:
+            # The results of k only depend on the substitution and on the
+            # Walnut commands that define them: the common prelude and the
+            # commands of k, which do not mention the last k.
+            cmddir = walnutdir / "Command Files"
+            prelude = (cmddir / "gen_abcomp.txt").read_text()
+            for cur in range(args.start, args.end + 1):
+                h = sha256()
+                for x in (args.subst, name, str(cur), prelude):
+                    h.update(x.encode())
+                    h.update(b"\0")
+                h.update((cmddir / f"gen_abcomp{cur}.txt").read_bytes())
+                key = f"{name}{cur}-{h.hexdigest()[:16]}"
+                artifacts = [
+                    f"Automata Library/abeq_{name}{cur}.txt",
+                    f"Result/comp_{name}{cur}.mpl",
+                    f"Word Automata Library/Comp_{name}{cur}.txt",
+                ]
+                f.write(f"""if [ -d "$ABCOMP_CACHE/{key}" ]; then
+  echo "k={cur}: found in $ABCOMP_CACHE/{key}"
+""")
+                for a in artifacts:
+                    f.write(f"""  cp "$ABCOMP_CACHE/{key}/{P(a).name}" "{a}" || exit 1
+""")
+                f.write(f"""else
+  echo "load gen_abcomp{cur}.txt;" | java -Xmx$WALNUT_MEM -jar $WALNUT_JAR 
+  semitrick Result/comp_{name}{cur}.mpl {base} Word\\ Automata\\ Library/Comp_{name}{cur}.txt
+  CACHETMP=$(mktemp -d "$ABCOMP_CACHE/.{key}.XXXXXX") || exit 1
+""")
+                for a in artifacts:
+                    f.write(f"""  cp "{a}" "$CACHETMP/" || exit 1
+""")
+                f.write(f"""  mv "$CACHETMP" "$ABCOMP_CACHE/{key}" || exit 1
+fi
+""")
         f.write(f"""cat << EOF | tr '\\n' '\\0' | tar cvzf ../abelian.tar.gz --null -T -
 Custom Bases/{base}.txt
 Custom Bases/{base}_addition.txt
@@ -376,7 +436,8 @@ Automata Library/abeq_{name}{cur}.txt
 """)
         f.write("EOF\n")
     goscr.chmod(goscr.stat().st_mode | stat.S_IEXEC)
-    walnut_out.close()
+    if args.cache is None:
+        walnut_out.close()
     py_out.close()
     make_archive(f"{args.name}", "zip", tmpdir.name, args.name)
     tmpdir.cleanup()
@@ -0,0 +1,220 @@
+#!/usr/bin/env python3
+import argparse
+import datetime
+import os
+import re
+import shutil
+import subprocess
+import sys
+import time
+import zipfile
+from pathlib import Path as P
+
+here = P(__file__).resolve().parent
+
+parser = argparse.ArgumentParser(
+                    prog='sched.py',
+                    description="""Run section4 jobs in parallel under a memory budget
+
+A job is a notebook samples/foo.qmd (rendered with render into out/foo.zip) or a
+zipped Walnut instance samples/foo.zip (its go script is run, the result is
+out/foo-abelian.tar.gz). The peak memory and the time of each job are recorded in
+the history file; the next runs reserve the recorded peak (plus a margin) for the
+job, give a fraction of it to the Walnut heap, and start the longest jobs first.
+The jobs without history are ordered by the times in their previous logs
+(out/foo.zip.log, or the logs given with --seed).""")
+parser.add_argument('jobs', nargs='+', help="samples/*.qmd or samples/*.zip files")
+parser.add_argument('-m', '--mem', default=None,
+                    help="Total memory budget, e.g. 200g (default: 90%% of the physical memory)")
+parser.add_argument('-d', '--default-mem', default=os.environ.get('WALNUT_MEM', '64g'),
+                    help="Reservation of a job without history (default: $WALNUT_MEM or 64g)")
+parser.add_argument('-M', '--margin', type=float, default=1.25, help="Reservation over the recorded peak")
+parser.add_argument('-F', '--heap-fraction', type=float, default=0.75,
+                    help="Part of the reservation given to the Walnut heap, the rest being for the JVM "
+                         "itself and semitrick (default: 0.75)")
+parser.add_argument('-o', '--outdir', default=str(here / 'out'), help="Output directory")
+parser.add_argument('-H', '--history', default=None, help="History file (default: [outdir]/sched.tsv)")
+parser.add_argument('-S', '--seed', nargs='+', metavar='LOG', default=[],
+                    help="Logs of previous runs (Walnut and section3 tools, named after the job: "
+                         "foo.log or foo.zip.log) giving the time of the jobs without history")
+parser.add_argument('-n', '--dry-run', action='store_true', help="Print the plan and exit")
+args = parser.parse_args()
+
+FIELDS = ['job', 'date', 'status', 'seconds', 'maxrss_kb', 'walnut_mem']
+
+
+def parse_mem(s):
+    """Size in KiB of 64g, 512m, 1t or a number of KiB."""
+    m = re.fullmatch(r'(\d+(?:\.\d+)?)([kmgt]?)b?', s.strip().lower())
+    if not m:
+        raise ValueError(f"invalid memory size: {s}")
+    return int(float(m.group(1)) * 1024 ** 'kmgt'.index(m.group(2) or 'k'))
+
+
+def pretty_mem(kb):
+    return f'{kb / 1024 ** 2:.1f}g' if kb >= 1024 ** 2 else f'{kb // 1024}m'
+
+
+def physical_mem():
+    with open('/proc/meminfo') as f:
+        for line in f:
+            if line.startswith('MemTotal:'):
+                return int(line.split()[1])
+    return os.sysconf('SC_PAGE_SIZE') * os.sysconf('SC_PHYS_PAGES') // 1024
+
+
+def read_history(path):
+    """The last successful run of each job."""
+    rows = {}
+    if not P(path).exists():
+        return rows
+    with open(path) as f:
+        header = f.readline().rstrip('\n').split('\t')
+        for line in f:
+            r = dict(zip(header, line.rstrip('\n').split('\t')))
+            if r['status'] == '0':
+                rows[r['job']] = r
+    return rows
+
+
+def parse_duration(s):
+    """Seconds of a duration of the section3 tools: 4.321s or [h:]m:ss."""
+    s = s.strip()
+    if s.endswith('s'):
+        return float(s[:-1])
+    t = 0
+    for x in s.split(':'):
+        t = 60 * t + int(x)
+    return float(t)
+
+
+def log_seconds(path):
+    """Computation time recorded in a log: the Walnut commands ("Total
+    computation time") and the stages of the section3 tools (">>>"), or
+    None if there is neither."""
+    seconds = None
+    with open(path, errors='replace') as f:
+        for line in f:
+            m = re.search(r'Total computation time: (\d+)ms', line)
+            if m:
+                seconds = (seconds or 0) + int(m.group(1)) / 1000
+            elif line.startswith('>>>'):
+                seconds = (seconds or 0) + parse_duration(line[3:])
+    return seconds
+
+
+def read_logs(paths):
+    """The time in the log of each job, by the name of the log without
+    .log (foo.zip or foo)."""
+    times = {}
+    for path in paths:
+        t = log_seconds(path)
+        if t is not None:
+            times[P(path).name.removesuffix('.log')] = t
+    return times
+
+
+def append_history(path, row):
+    new = not P(path).exists()
+    with open(path, 'a') as f:
+        if new:
+            f.write('\t'.join(FIELDS) + '\n')
+        f.write('\t'.join(str(row.get(k, '-')) for k in FIELDS) + '\n')
+
+
+outdir = P(args.outdir)
+outdir.mkdir(parents=True, exist_ok=True)
+history_file = args.history or outdir / 'sched.tsv'
+history = read_history(history_file)
+budget = parse_mem(args.mem) if args.mem else physical_mem() * 9 // 10
+default_mem = parse_mem(args.default_mem)
+logged = read_logs(sorted(outdir.glob('*.log')) + args.seed)
+
+
+class Job:
+    def __init__(self, path):
+        self.path = P(path).resolve()
+        self.name = self.path.name
+        h = history.get(self.name)
+        self.known = h is not None
+        logs = [logged[k] for k in (self.name, self.path.stem) if k in logged]
+        self.logged = not self.known and bool(logs)
+        self.seconds = float(h['seconds']) if h else logs[0] if logs else float('inf')
+        self.mem = min(default_mem, int(int(h['maxrss_kb']) * args.margin)) if h else default_mem
+        self.work = None
+
+    def command(self):
+        """Command line and working directory of the job."""
+        stem = self.path.stem
+        if self.path.suffix == '.qmd':
+            return [str(here / 'render'), str(self.path)], outdir
+        # the instance is unpacked in out/foo.run, kept if the job fails
+        self.work = outdir / f'{stem}.run'
+        shutil.rmtree(self.work, ignore_errors=True)
+        self.work.mkdir()
+        with zipfile.ZipFile(self.path) as z:
+            z.extractall(self.work)
+        (self.work / stem / 'go').chmod(0o755)
+        return ['sh', '-c', f'./go && mv abelian.tar.gz {outdir / (stem + "-abelian.tar.gz")}'], self.work / stem
+
+
+def start(job, mem):
+    cmd, cwd = job.command()
+    env = dict(os.environ, WALNUT_MEM=f'{int(mem * args.heap_fraction) // 1024}m')
+    env.setdefault('WALNUT_JAR', str(here / 'aux' / 'walnut-6.2.jar'))
+    # semitrick, for the go scripts
+    env['PATH'] = f"{here.parent / 'section3' / 'src'}{os.pathsep}{env.get('PATH', '')}"
+    log = open(outdir / f'{job.name}.log', 'w')
+    proc = subprocess.Popen(cmd, cwd=cwd, env=env, stdout=log, stderr=subprocess.STDOUT)
+    log.close()
+    return proc
+
+
+# Longest first (the jobs without history nor log are assumed to be the
+# longest).
+pending = sorted((Job(j) for j in args.jobs), key=lambda j: -j.seconds)
+print(f"budget {pretty_mem(budget)}")
+for j in pending:
+    when = f'{j.seconds:.0f}s' if j.known else f'{j.seconds:.0f}s (log)' if j.logged else '(no history)'
+    print(f"{j.name:>16} {pretty_mem(j.mem):>8} {when:>14}")
+if args.dry_run:
+    sys.exit(0)
+
+running = {}
+retried = set()
+failed = 0
+while pending or running:
+    # Start every pending job that fits in what is left of the budget,
+    # in order; a job larger than the budget runs alone.
+    used = sum(mem for (_, mem, _) in running.values())
+    for j in list(pending):
+        if used + j.mem <= budget or not running:
+            proc = start(j, j.mem)
+            running[proc.pid] = (j, j.mem, time.monotonic())
+            used += j.mem
+            pending.remove(j)
+            print(f"[{datetime.datetime.now():%H:%M:%S}] start {j.name} ({pretty_mem(j.mem)}, "
+                  f"{pretty_mem(used)} reserved)", flush=True)
+    pid, status, usage = os.wait4(-1, 0)
+    if pid not in running:
+        continue
+    j, mem, t0 = running.pop(pid)
+    wall = time.monotonic() - t0
+    rss = usage.ru_maxrss // 1024 if sys.platform == 'darwin' else usage.ru_maxrss
+    code = os.waitstatus_to_exitcode(status)
+    append_history(history_file, dict(job=j.name, date=f'{datetime.date.today()}', status=code,
+                                      seconds=f'{wall:.0f}', maxrss_kb=rss, walnut_mem=f'{mem // 1024}m'))
+    print(f"[{datetime.datetime.now():%H:%M:%S}] done {j.name}: status {code}, {wall:.0f}s, "
+          f"peak {pretty_mem(rss)}", flush=True)
+    if code == 0 and j.work is not None:
+        shutil.rmtree(j.work, ignore_errors=True)
+    if code != 0 and mem < default_mem and j.name not in retried:
+        # the recorded peak was too small for this run: once more with
+        # the default reservation
+        retried.add(j.name)
+        j.mem = default_mem
+        pending.insert(0, j)
+    elif code != 0:
+        failed += 1
+
+sys.exit(1 if failed else 0)